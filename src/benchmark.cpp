@@ -18,11 +18,23 @@
 
 #include "benchmark.h"
 
+#include <algorithm>
+#include <cctype>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
+#include <deque>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include <vector>
 
+#include "bitboard.h"
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "book/file_mapping.h"
+
 namespace {
 
 // clang-format off
@@ -95,10 +107,10 @@ const std::vector<std::string> Defaults = {
 
 namespace Hypnos::Benchmark {
 
-// Builds a list of UCI commands to be run by bench. There
+// Builds the UCI commands to be run by bench. There
 // are five parameters: TT size in MB, number of search threads that
 // should be used, the limit value spent for each position, a file name
-// where to look for positions in FEN format, and the type of the limit:
+// where to look for positions in FEN or EPD format, and the type of the limit:
 // depth, perft, nodes and movetime (in milliseconds). Examples:
 //
 // bench                            : search default positions up to depth 13
@@ -106,10 +118,9 @@ namespace Hypnos::Benchmark {
 // bench 64 1 100000 default nodes  : search default positions for 100K nodes each
 // bench 64 4 5000 current movetime : search current position with 4 threads for 5 sec
 // bench 16 1 5 blah perft          : run a perft 5 on positions in file "blah"
-std::vector<std::string> setup_bench(const std::string& currentFen, std::istream& is) {
+BenchCommands::BenchCommands(const std::string& currentFen, std::istream& is) {
 
-    std::vector<std::string> fens, list;
-    std::string              go, token;
+    std::string token;
 
     // Assign default values to missing arguments
     std::string ttSize    = (is >> token) ? token : "16";
@@ -128,36 +139,430 @@ std::vector<std::string> setup_bench(const std::string& currentFen, std::istream
 
     else
     {
-        std::string   fen;
-        std::ifstream file(fenFile);
-
-        if (!file.is_open())
+        if (!reader.open(fenFile))
         {
             std::cerr << "Unable to open file " << fenFile << std::endl;
             exit(EXIT_FAILURE);
         }
 
-        while (getline(file, fen))
-            if (!fen.empty())
-                fens.push_back(fen);
+        fromFile = true;
+    }
+
+    header.emplace_back("setoption name Threads value " + threads);
+    header.emplace_back("setoption name Hash value " + ttSize);
+    header.emplace_back("ucinewgame");
+
+    // Count the positions ahead, reporting the lines that are skipped
+    for (std::string line; next_line(line, true);)
+        positionCount += line.find("setoption") == std::string::npos;
+
+    rewind();
+}
+
+// Returns the next command, false once all of them have been returned
+bool BenchCommands::next(std::string& cmd) {
+
+    if (!pending.empty())
+    {
+        cmd = std::move(pending);
+        pending.clear();
+        return true;
+    }
+
+    if (headerIdx < header.size())
+    {
+        cmd = header[headerIdx++];
+        return true;
+    }
+
+    if (!next_line(cmd, false))
+        return false;
+
+    if (cmd.find("setoption") == std::string::npos)
+    {
+        cmd     = "position fen " + cmd;
+        pending = go;
+    }
+
+    return true;
+}
+
+// Starts again from the first command
+void BenchCommands::rewind() {
+
+    reader.rewind();
+    pending.clear();
+    headerIdx = fenIdx = 0;
+}
 
-        file.close();
+// Reads the next position, or setoption command, of the file or of the list.
+// The lines of the file that are not positions are skipped, and reported when
+// asked to.
+bool BenchCommands::next_line(std::string& line, bool report) {
+
+    if (!fromFile)
+    {
+        if (fenIdx == fens.size())
+            return false;
+
+        line = fens[fenIdx++];
+        return true;
     }
 
-    list.emplace_back("setoption name Threads value " + threads);
-    list.emplace_back("setoption name Hash value " + ttSize);
-    list.emplace_back("ucinewgame");
+    std::string_view view;
+    EpdRecord        rec;
+
+    while (reader.next(view))
+    {
+        if (view.find("setoption") != std::string_view::npos)
+        {
+            line = view;
+            return true;
+        }
+
+        if (!parse_epd(view, rec))
+        {
+            if (report)
+                std::cerr << "Skipping line that is not a position: " << view << std::endl;
+
+            continue;
+        }
+
+        line = rec.fen;
+
+        if (!rec.moves.empty())
+            line += " moves";
+
+        for (const std::string& m : rec.moves)
+            line += " " + m;
+
+        return true;
+    }
+
+    return false;
+}
+
+
+namespace {
+
+bool is_number(std::string_view token) {
+    return !token.empty()
+        && std::all_of(token.begin(), token.end(), [](char c) { return std::isdigit(c); });
+}
+
+// Removes the annotations and the spelling variants that are not relevant
+// to identify a move in SAN: check and mate signs, "!?" suffixes, the '='
+// before a promotion and zeros in castling moves.
+std::string normalize_san(std::string_view san) {
+    std::string str;
+
+    for (char c : san)
+        if (!std::strchr("+#!?=", c))
+            str += c == '0' ? 'O' : c;
+
+    return str;
+}
+
+// Returns the SAN of a legal move, without check and mate signs
+std::string to_san(const Position& pos, Move m) {
+
+    const Square    from = m.from_sq(), to = m.to_sq();
+    const PieceType pt   = type_of(pos.moved_piece(m));
+    std::string     san;
+
+    if (m.type_of() == CASTLING)
+        return to > from ? "O-O" : "O-O-O";
+
+    if (pt == PAWN)
+    {
+        if (pos.capture(m))
+            san += char('a' + file_of(from));
+    }
+    else
+    {
+        Bitboard others = 0;
+
+        san += " PNBRQK"[pt];
+
+        // Disambiguate with the file, the rank or both, when another piece
+        // of the same type can move to the same square.
+        for (const auto& om : MoveList<LEGAL>(pos))
+            if (om != m && om.to_sq() == to && type_of(pos.moved_piece(om)) == pt)
+                others |= om.from_sq();
+
+        if (others & file_bb(from))
+        {
+            if (others & rank_bb(from))
+                san += char('a' + file_of(from));
+
+            san += char('1' + rank_of(from));
+        }
+        else if (others)
+            san += char('a' + file_of(from));
+    }
+
+    if (pos.capture(m))
+        san += 'x';
+
+    san += char('a' + file_of(to));
+    san += char('1' + rank_of(to));
+
+    if (m.type_of() == PROMOTION)
+        san += " PNBRQK"[m.promotion_type()];
+
+    return san;
+}
+
+}  // namespace
+
+// Parses a line of an EPD file, or a FEN optionally followed by its move
+// clocks and a "moves" list. Returns false if the line does not start
+// with the four fields of a position.
+bool parse_epd(std::string_view line, EpdRecord& rec) {
+
+    std::istringstream       ss{std::string(line)};
+    std::vector<std::string> fields(4);
+    std::string              token, halfmove = "0", fullmove = "1";
+
+    rec = EpdRecord();
+
+    for (auto& f : fields)
+        if (!(ss >> f))
+            return false;
 
-    for (const std::string& fen : fens)
-        if (fen.find("setoption") != std::string::npos)
-            list.emplace_back(fen);
+    // FEN move clocks
+    auto mark = ss.tellg();
+    if (ss >> token && is_number(token))
+    {
+        halfmove = token;
+        mark     = ss.tellg();
+        if (ss >> token && is_number(token))
+            fullmove = token;
         else
+            ss.seekg(mark);
+    }
+    else
+    {
+        ss.clear();
+        ss.seekg(mark);
+    }
+
+    if (ss >> token && token == "moves")
+        while (ss >> token)
+            rec.moves.push_back(token);
+
+    else if (!token.empty() && ss)
+    {
+        // EPD operations are separated by semicolons, which may also appear
+        // inside quoted operands.
+        std::string rest   = token + std::string(std::istreambuf_iterator<char>(ss), {});
+        bool        quoted = false;
+        std::string op;
+
+        for (char c : rest + ';')
+        {
+            if (c == '"')
+                quoted = !quoted;
+
+            if (c != ';' || quoted)
+            {
+                op += c;
+                continue;
+            }
+
+            std::istringstream       ops(op);
+            std::string              opcode, operand;
+            std::vector<std::string> operands;
+
+            ops >> opcode;
+            while (ops >> operand)
+                operands.push_back(operand);
+
+            if (opcode == "bm")
+                rec.bestMoves = operands;
+            else if (opcode == "am")
+                rec.avoidMoves = operands;
+            else if (opcode == "ce" && !operands.empty())
+                rec.ce = std::atoi(operands[0].c_str());
+            else if (opcode == "hmvc" && !operands.empty())
+                halfmove = operands[0];
+            else if (opcode == "fmvn" && !operands.empty())
+                fullmove = operands[0];
+            else if (opcode == "id")
+            {
+                auto first = op.find('"'), last = op.rfind('"');
+                rec.id     = first < last ? op.substr(first + 1, last - first - 1)
+                                          : (operands.empty() ? "" : operands[0]);
+            }
+
+            op.clear();
+        }
+    }
+
+    rec.fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " " + halfmove
+            + " " + fullmove;
+
+    return true;
+}
+
+// Converts a move in SAN to a legal move in the given position, returns
+// Move::none() if there is no such move.
+Move parse_san(const Position& pos, std::string_view san) {
+
+    const std::string str = normalize_san(san);
+
+    for (const auto& m : MoveList<LEGAL>(pos))
+        if (normalize_san(to_san(pos, m)) == str)
+            return m;
+
+    return Move::none();
+}
+
+// Measures the throughput of each slider attack backend available in this build
+// on the bench positions: queen attack lookups from every square with the
+// occupancy of the position, legal move generation, making and unmaking the
+// legal moves, and SEE of the captures. The attack checksums of the backends
+// must agree. Compare builds with and without attack maps for the cost of
+// maintaining them in do_move() and their savings in see_ge().
+std::string attacks_bench() {
+
+    const SliderBackend     current = SliderAttacks;
+    std::deque<Position>    positions;
+    std::deque<StateInfo>   states;
+    std::vector<Bitboard>   occupancies;
+    std::optional<Bitboard> reference;
+    std::stringstream       ss;
+    EpdRecord               rec;
+
+    for (const std::string& line : Defaults)
+        if (line.find("setoption") == std::string::npos && parse_epd(line, rec))
         {
-            list.emplace_back("position fen " + fen);
-            list.emplace_back(go);
+            positions.emplace_back().set(rec.fen, false, &states.emplace_back());
+            occupancies.push_back(positions.back().pieces());
         }
 
-    return list;
+    ss << "Attack maps: " << (HasAttackMaps ? "yes" : "no") << std::endl
+       << "Backend  Footprint (KB)  Lookups/s    Legal moves/s  Make/unmake/s  SEE/s"
+       << std::endl;
+
+    for (int i = 0; i < SLIDER_BACKEND_NB; ++i)
+    {
+        const SliderBackend sb = SliderBackend(i);
+
+        if (!Bitboards::set_slider_backend(sb))
+            continue;
+
+        uint64_t          lookups = 0, moves = 0, made = 0, sees = 0;
+        volatile Bitboard sink    = 0;
+        TimePoint         elapsed = now();
+
+        // The volatile accesses keep the lookups between the two clock reads
+        Bitboard checksum = sink;
+
+        // Flip a few squares of the first rank according to the previous
+        // lookups, so that the lookups cannot be hoisted out of the loop even
+        // when the backend is a compile-time constant.
+        for (int n = 0; n < 20000; ++n)
+            for (Bitboard occupied : occupancies)
+                for (Square s = SQ_A1; s <= SQ_H8; ++s, ++lookups)
+                    checksum += attacks_bb<QUEEN>(s, occupied ^ (checksum & 7));
+
+        sink = checksum;
+
+        TimePoint lookupTime = now() - elapsed + 1;
+        elapsed              = now();
+
+        for (int n = 0; n < 2000; ++n)
+            for (const Position& pos : positions)
+                moves += MoveList<LEGAL>(pos).size();
+
+        TimePoint movegenTime = now() - elapsed + 1;
+        elapsed               = now();
+
+        for (int n = 0; n < 500; ++n)
+            for (Position& pos : positions)
+                for (const auto& m : MoveList<LEGAL>(pos))
+                {
+                    StateInfo st;
+                    pos.do_move(m, st);
+                    pos.undo_move(m);
+                    ++made;
+                }
+
+        TimePoint makeTime = now() - elapsed + 1;
+        elapsed            = now();
+
+        for (int n = 0; n < 2000; ++n)
+            for (const Position& pos : positions)
+            {
+                // CAPTURES requires a position without checkers
+                if (pos.checkers())
+                    continue;
+
+                for (const auto& m : MoveList<CAPTURES>(pos))
+                {
+                    checksum += pos.see_ge(m, 0);
+                    ++sees;
+                }
+            }
+
+        TimePoint seeTime = now() - elapsed + 1;
+
+        ss << std::left << std::setw(9) << Bitboards::slider_backend_name(sb)  //
+           << std::setw(16) << Bitboards::slider_backend_footprint(sb) / 1024  //
+           << std::setw(13) << 1000 * lookups / lookupTime                     //
+           << std::setw(15) << 1000 * moves / movegenTime                      //
+           << std::setw(15) << 1000 * made / makeTime                          //
+           << 1000 * sees / seeTime << std::endl;
+
+        if (reference && *reference != checksum)
+            ss << "Checksum mismatch: " << checksum << " instead of " << *reference << std::endl;
+
+        reference = checksum;
+    }
+
+    Bitboards::set_slider_backend(current);
+
+    ss << "Current backend: " << Bitboards::slider_backend_name(current);
+
+    return ss.str();
+}
+
+bool EpdReader::open(const std::string& file) {
+
+    mapping = std::make_shared<FileMapping>();
+
+    if (!mapping->map(file, false))
+        return false;
+
+    begin = cur = reinterpret_cast<const char*>(mapping->data());
+    end         = cur + mapping->data_size();
+    return true;
+}
+
+bool EpdReader::next(std::string_view& line) {
+
+    while (cur < end)
+    {
+        const char* eol = static_cast<const char*>(std::memchr(cur, '\n', end - cur));
+
+        if (!eol)
+            eol = end;
+
+        line = std::string_view(cur, eol - cur);
+        cur  = eol + 1;
+
+        while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back())))
+            line.remove_suffix(1);
+
+        while (!line.empty() && std::isspace(static_cast<unsigned char>(line.front())))
+            line.remove_prefix(1);
+
+        if (!line.empty() && line.front() != '#')
+            return true;
+    }
+
+    return false;
 }
 
-}  // namespace Hypnos
\ No newline at end of file
+}  // namespace Hypnos
@@ -19,13 +19,77 @@
 #ifndef BENCHMARK_H_INCLUDED
 #define BENCHMARK_H_INCLUDED
 
+#include <cstddef>
 #include <iosfwd>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "types.h"
+
+class FileMapping;
+
+namespace Hypnos {
+class Position;
+}
+
 namespace Hypnos::Benchmark {
 
-std::vector<std::string> setup_bench(const std::string&, std::istream&);
+std::string attacks_bench();
+
+// A position of an EPD test suite together with the opcodes we care about.
+// Plain FEN lines, optionally followed by "moves ...", are accepted as well.
+struct EpdRecord {
+    std::string              fen;
+    std::vector<std::string> moves;       // Moves played from fen, in UCI notation
+    std::vector<std::string> bestMoves;   // "bm" operands, in SAN or UCI notation
+    std::vector<std::string> avoidMoves;  // "am" operands, in SAN or UCI notation
+    std::string              id;
+    std::optional<int>       ce;
+};
+
+bool parse_epd(std::string_view line, EpdRecord& rec);
+Move parse_san(const Position& pos, std::string_view san);
+
+// EpdReader streams the lines of a memory-mapped EPD or FEN file, so that
+// huge test suites are never copied in memory. Empty lines and comments
+// starting with '#' are skipped.
+class EpdReader {
+   public:
+    bool open(const std::string& file);
+    bool next(std::string_view& line);
+    void rewind() { cur = begin; }
+
+   private:
+    std::shared_ptr<FileMapping> mapping;
+    const char*                  begin = nullptr;
+    const char*                  cur   = nullptr;
+    const char*                  end   = nullptr;
+};
+
+// BenchCommands yields the UCI commands run by bench one at a time. The
+// positions of a file are parsed as they are run, straight from the mapped
+// file, so that the commands of a huge file are never held in memory.
+class BenchCommands {
+   public:
+    BenchCommands(const std::string& currentFen, std::istream& is);
+
+    bool   next(std::string& cmd);
+    void   rewind();
+    size_t positions() const { return positionCount; }  // Number of searched positions
+
+   private:
+    bool next_line(std::string& line, bool report);
+
+    std::vector<std::string> header;  // Threads, Hash and ucinewgame
+    std::vector<std::string> fens;    // Default or current positions, no file given
+    EpdReader                reader;
+    bool                     fromFile = false;
+    std::string              go, pending;
+    size_t                   headerIdx = 0, fenIdx = 0, positionCount = 0;
+};
 
 }  // namespace Hypnos
 
@@ -24,6 +24,14 @@
 
 #include "misc.h"
 
+#if defined(USE_PEXT)
+    #if defined(_MSC_VER)
+        #include <intrin.h>  // Microsoft header for __cpuid()
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
 namespace Hypnos {
 
 uint8_t PopCnt16[1 << 16];
@@ -37,12 +45,26 @@ Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 Magic RookMagics[SQUARE_NB];
 Magic BishopMagics[SQUARE_NB];
 
+SliderLine SliderLines[SQUARE_NB][4];
+
+#ifdef USE_SLIDER_BACKENDS
+SliderBackend SliderAttacks = SLIDER_MAGIC;
+#endif
+
 namespace {
 
 Bitboard RookTable[0x19000];   // To store rook attacks
 Bitboard BishopTable[0x1480];  // To store bishop attacks
 
+#ifdef USE_SLIDER_BACKENDS
+// The indexing scheme the attack tables are currently filled for
+SliderBackend TablesIndexing = SLIDER_MAGIC;
+
+void fill_magics(PieceType pt, Magic magics[]);
+#endif
+
 void init_magics(PieceType pt, Bitboard table[], Magic magics[]);
+void init_slider_lines();
 
 // Returns the bitboard of target square for the given step
 // from the given square. If the step is off the board, returns empty bitboard.
@@ -84,6 +106,7 @@ void Bitboards::init() {
 
     init_magics(ROOK, RookTable, RookMagics);
     init_magics(BISHOP, BishopTable, BishopMagics);
+    init_slider_lines();
 
     for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
     {
@@ -111,6 +134,81 @@ void Bitboards::init() {
                 BetweenBB[s1][s2] |= s2;
             }
     }
+
+    set_slider_backend(default_slider_backend());
+}
+
+
+// Selects the backend used by attacks_bb() for sliding pieces. The attack
+// tables are refilled when switching between the two magic indexing schemes,
+// so this must not be called during a search. Returns false if the backend
+// is not available in this build.
+bool Bitboards::set_slider_backend(SliderBackend sb) {
+
+#ifdef USE_SLIDER_BACKENDS
+    if (sb == SLIDER_PEXT && !HasPext)
+        return false;
+
+    if (sb != SLIDER_COMPACT && sb != TablesIndexing)
+    {
+        SliderAttacks = sb;
+        fill_magics(ROOK, RookMagics);
+        fill_magics(BISHOP, BishopMagics);
+        TablesIndexing = sb;
+    }
+
+    SliderAttacks = sb;
+    return true;
+#else
+    return sb == SliderAttacks;
+#endif
+}
+
+
+// Returns the fastest backend for the running CPU. AMD processors before Zen 3
+// implement pext in microcode with a latency growing with the number of bits
+// of the mask, so there the multiplication of the magics is much faster.
+SliderBackend Bitboards::default_slider_backend() {
+
+#if !defined(USE_SLIDER_BACKENDS)
+    return SliderAttacks;
+#elif defined(USE_PEXT)
+    unsigned regs[4];
+
+    #if defined(_MSC_VER)
+    __cpuid(reinterpret_cast<int*>(regs), 0);
+    #else
+    __cpuid(0, regs[0], regs[1], regs[2], regs[3]);
+    #endif
+
+    bool isAmd = regs[1] == 0x68747541;  // "Auth" of "AuthenticAMD"
+
+    #if defined(_MSC_VER)
+    __cpuid(reinterpret_cast<int*>(regs), 1);
+    #else
+    __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+    #endif
+
+    unsigned family = (regs[0] >> 8) & 0xF;
+    if (family == 0xF)
+        family += (regs[0] >> 20) & 0xFF;
+
+    return isAmd && family < 0x19 ? SLIDER_MAGIC : SLIDER_PEXT;
+#else
+    return SLIDER_MAGIC;
+#endif
+}
+
+const char* Bitboards::slider_backend_name(SliderBackend sb) {
+    constexpr const char* Names[] = {"Magic", "Pext", "Compact"};
+    return Names[sb];
+}
+
+// Returns the size in bytes of the lookup data used by a backend
+size_t Bitboards::slider_backend_footprint(SliderBackend sb) {
+    return sb == SLIDER_COMPACT
+           ? sizeof(SliderLines)
+           : sizeof(RookTable) + sizeof(BishopTable) + sizeof(RookMagics) + sizeof(BishopMagics);
 }
 
 namespace {
@@ -177,14 +275,15 @@ void init_magics(PieceType pt, Bitboard table[], Magic magics[]) {
             occupancy[size] = b;
             reference[size] = sliding_attack(pt, s, b);
 
-            if (HasPext)
+            if (!HasSliderBackends && SliderAttacks == SLIDER_PEXT)
                 m.attacks[pext(b, m.mask)] = reference[size];
 
             size++;
             b = (b - m.mask) & m.mask;
         } while (b);
 
-        if (HasPext)
+        // No magics are needed when pext is the only backend of the build
+        if (!HasSliderBackends && SliderAttacks == SLIDER_PEXT)
             continue;
 
         PRNG rng(seeds[Is64Bit][rank_of(s)]);
@@ -217,6 +316,49 @@ void init_magics(PieceType pt, Bitboard table[], Magic magics[]) {
         }
     }
 }
+
+
+#ifdef USE_SLIDER_BACKENDS
+// Refills the attack tables for the indexing scheme of the current backend,
+// the magics and the table offsets being unchanged.
+void fill_magics(PieceType pt, Magic magics[]) {
+
+    for (Square s = SQ_A1; s <= SQ_H8; ++s)
+    {
+        Magic&   m = magics[s];
+        Bitboard b = 0;
+
+        do
+        {
+            m.attacks[m.index(b)] = sliding_attack(pt, s, b);
+            b                     = (b - m.mask) & m.mask;
+        } while (b);
+    }
+}
+#endif
+
+
+// Computes the masks of the file, rank, diagonal and anti-diagonal through
+// each square for the compact backend. The lower part of a line holds the
+// squares with a smaller index than the square.
+void init_slider_lines() {
+
+    constexpr Direction Up[4] = {NORTH, EAST, NORTH_EAST, NORTH_WEST};
+
+    for (Square s = SQ_A1; s <= SQ_H8; ++s)
+        for (int i = 0; i < 4; ++i)
+        {
+            SliderLine& l = SliderLines[s][i];
+
+            for (Square t = s; safe_destination(t, Up[i]);)
+                l.upper |= (t += Up[i]);
+
+            for (Square t = s; safe_destination(t, -Up[i]);)
+                l.lower |= (t -= Up[i]);
+
+            l.line = l.lower | l.upper;
+        }
+}
 }
 
 }  // namespace Hypnos
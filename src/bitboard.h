@@ -30,11 +30,27 @@
 
 namespace Hypnos {
 
+// The backends available to compute the attacks of sliding pieces. Both magic
+// backends share the same 840 KB of attack tables, filled according to the
+// indexing scheme, while the compact one only needs 6 KB of line masks and
+// leaves the L2 cache to the rest of the engine.
+enum SliderBackend : uint8_t {
+    SLIDER_MAGIC,    // Fancy magic bitboards, multiply-shift indexing
+    SLIDER_PEXT,     // Fancy magic bitboards, indexed by the BMI2 pext instruction
+    SLIDER_COMPACT,  // Obstruction difference on the lines through the square
+    SLIDER_BACKEND_NB
+};
+
 namespace Bitboards {
 
 void        init();
 std::string pretty(Bitboard b);
 
+bool          set_slider_backend(SliderBackend sb);
+SliderBackend default_slider_backend();
+const char*   slider_backend_name(SliderBackend sb);
+size_t        slider_backend_footprint(SliderBackend sb);
+
 }  // namespace Hypnos::Bitboards
 
 constexpr Bitboard FileABB = 0x0101010101010101ULL;
@@ -63,6 +79,14 @@ extern Bitboard LineBB[SQUARE_NB][SQUARE_NB];
 extern Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 extern Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 
+// Without run-time selection the backend is a constant, so that attacks_bb()
+// and Magic::index() do not branch on it.
+#ifdef USE_SLIDER_BACKENDS
+extern SliderBackend SliderAttacks;
+#else
+constexpr SliderBackend SliderAttacks = HasPext ? SLIDER_PEXT : SLIDER_MAGIC;
+#endif
+
 
 // Magic holds all magic bitboards relevant data for a single square
 struct Magic {
@@ -74,7 +98,7 @@ struct Magic {
     // Compute the attack's index using the 'magic bitboards' approach
     unsigned index(Bitboard occupied) const {
 
-        if (HasPext)
+        if (HasPext && SliderAttacks == SLIDER_PEXT)
             return unsigned(pext(occupied, mask));
 
         if (Is64Bit)
@@ -89,6 +113,17 @@ struct Magic {
 extern Magic RookMagics[SQUARE_NB];
 extern Magic BishopMagics[SQUARE_NB];
 
+// SliderLine holds the masks of a line through a square used by the compact
+// backend: the squares of the line below and above the square, and their union.
+struct SliderLine {
+    Bitboard lower;
+    Bitboard upper;
+    Bitboard line;
+};
+
+// File, rank, diagonal and anti-diagonal through each square
+extern SliderLine SliderLines[SQUARE_NB][4];
+
 constexpr Bitboard square_bb(Square s) {
     assert(is_ok(s));
     return (1ULL << s);
@@ -218,6 +253,22 @@ inline Bitboard attacks_bb(Square s) {
 }
 
 
+inline Square msb(Bitboard b);
+
+// Returns the attacks along a line with the "obstruction difference" trick, see
+// www.chessprogramming.org/Obstruction_Difference. The nearest blocker below the
+// square gives the lowest attacked square, and the carry of the subtraction
+// stops at the nearest blocker above it.
+inline Bitboard line_attacks(const SliderLine& l, Bitboard occupied) {
+
+    Bitboard lower = l.lower & occupied;
+    Bitboard upper = l.upper & occupied;
+    Bitboard ms1b  = ~Bitboard(0) << msb(lower | 1);
+    Bitboard ls1b  = upper & (0 - upper);
+
+    return l.line & (2 * ls1b + ms1b);
+}
+
 // Returns the attacks by the given piece
 // assuming the board is occupied according to the passed Bitboard.
 // Sliding piece attacks do not continue passed an occupied square.
@@ -229,8 +280,16 @@ inline Bitboard attacks_bb(Square s, Bitboard occupied) {
     switch (Pt)
     {
     case BISHOP :
+        if (SliderAttacks == SLIDER_COMPACT)
+            return line_attacks(SliderLines[s][2], occupied)
+                 | line_attacks(SliderLines[s][3], occupied);
+
         return BishopMagics[s].attacks[BishopMagics[s].index(occupied)];
     case ROOK :
+        if (SliderAttacks == SLIDER_COMPACT)
+            return line_attacks(SliderLines[s][0], occupied)
+                 | line_attacks(SliderLines[s][1], occupied);
+
         return RookMagics[s].attacks[RookMagics[s].index(occupied)];
     case QUEEN :
         return attacks_bb<BISHOP>(s, occupied) | attacks_bb<ROOK>(s, occupied);
@@ -72,6 +72,10 @@ class Book {
 
     virtual Move probe(const Position& pos, size_t width, bool onlyGreen) const = 0;
     virtual void show_moves(const Position& pos) const                          = 0;
+
+    // Bytes of the book copied in memory, and bytes of its files mapped instead
+    virtual size_t memory_size() const = 0;
+    virtual size_t mapped_size() const = 0;
 };
 }
 }
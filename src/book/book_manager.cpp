@@ -90,4 +90,24 @@ void BookManager::show_moves(const Position& pos, const OptionsMap& options) con
         }
     }
 }
+
+size_t BookManager::memory_size() const {
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < NumberOfBooks; ++i)
+        if (books[i] != nullptr)
+            bytes += books[i]->memory_size();
+
+    return bytes;
+}
+
+size_t BookManager::mapped_size() const {
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < NumberOfBooks; ++i)
+        if (books[i] != nullptr)
+            bytes += books[i]->mapped_size();
+
+    return bytes;
+}
 }
\ No newline at end of file
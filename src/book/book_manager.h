@@ -24,6 +24,9 @@ class BookManager {
     void init(int index, const OptionsMap& options);
     Move probe(const Position& pos, const OptionsMap& options) const;
     void show_moves(const Position& pos, const OptionsMap& options) const;
+
+    size_t memory_size() const;
+    size_t mapped_size() const;
 };
 }
 
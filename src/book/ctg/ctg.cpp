@@ -907,7 +907,10 @@ void CtgBook::get_moves(const Position&        pos,
     //Position object to be used to play the moves
     StateInfo si[2];
     Position  p;
-    p.set(pos.fen(), pos.is_chess960(), &si[0]);
+    if (pos.packable())
+        p.decode(pos.encode(), &si[0]);
+    else
+        p.set(pos.fen(), pos.is_chess960(), &si[0]);
 
     //Read position statistics
     get_stats(positionData, ctgMoveList.positionStats, false);
@@ -1027,6 +1030,12 @@ void CtgBook::close() {
 
 bool CtgBook::is_open() const { return isOpen; }
 
+size_t CtgBook::memory_size() const { return 0; }
+
+size_t CtgBook::mapped_size() const {
+    return (cto.has_data() ? cto.data_size() : 0) + (ctg.has_data() ? ctg.data_size() : 0);
+}
+
 Move CtgBook::probe(const Position& pos, size_t width, bool onlyGreen) const {
     if (!is_open())
         return Move::none();
@@ -60,6 +60,9 @@ class CtgBook: public Book {
     virtual Move probe(const Position& pos, size_t width, bool onlyGreen) const;
 
     virtual void show_moves(const Position& pos) const;
+
+    virtual size_t memory_size() const;
+    virtual size_t mapped_size() const;
 };
 }
 }
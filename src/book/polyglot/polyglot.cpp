@@ -2,6 +2,7 @@
 #include <sstream>
 #include <iomanip>
 #include <random>
+#include "../../memory.h"
 #include "../../position.h"
 #include "../../uci.h"
 #include "../file_mapping.h"
@@ -388,9 +389,13 @@ PolyglotBook::~PolyglotBook() { close(); }
 
 std::string PolyglotBook::type() const { return "BIN"; }
 
+size_t PolyglotBook::memory_size() const { return bookDataLength; }
+
+size_t PolyglotBook::mapped_size() const { return 0; }
+
 void PolyglotBook::close() {
     if (bookData)
-        free(bookData);
+        aligned_large_pages_free(bookData);
 
     bookData       = nullptr;
     bookDataLength = 0;
@@ -416,7 +421,7 @@ bool PolyglotBook::open(const std::string& f) {
         return false;
     }
 
-    void* inData = malloc(fm.data_size());
+    void* inData = aligned_large_pages_alloc(fm.data_size());
     if (!inData)
     {
         sync_cout << "info string Could not allocate " << Util::format_bytes(fm.data_size(), 2)
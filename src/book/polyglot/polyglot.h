@@ -40,6 +40,9 @@ class PolyglotBook: public Book {
     virtual Move probe(const Position& pos, size_t width, bool onlyGreen) const;
 
     void show_moves(const Position& pos) const;
+
+    virtual size_t memory_size() const;
+    virtual size_t mapped_size() const;
 };
 }
 }
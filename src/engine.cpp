@@ -18,9 +18,12 @@
 
 #include "engine.h"
 
+#include <algorithm>
 #include <cassert>
 #include <deque>
+#include <iomanip>
 #include <iosfwd>
+#include <map>
 #include <memory>
 #include <ostream>
 #include <sstream>
@@ -28,6 +31,7 @@
 #include <utility>
 #include <vector>
 
+#include "bitboard.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "nnue/network.h"
@@ -73,16 +77,35 @@ Engine::Engine(std::string path) :
         return numa_config_information_as_string() + "\n" + thread_binding_information_as_string();
     });
 
+    options["NumaReplication"] << Option("node var node var l3", "node",
+                                         [this](const Option&) -> std::optional<std::string> {
+                                             set_numa_config_from_option(options["NumaPolicy"]);
+                                             return memory_information_as_string(false);
+                                         });
+
     options["Threads"] << Option(1, 1, 1024, [this](const Option&) -> std::optional<std::string> {
         resize_threads();
         return thread_binding_information_as_string();
     });
 
-    options["Hash"] << Option(16, 1, MaxHashMB, [this](const Option& o) -> std::optional<std::string> {
-        set_tt_size(o);
-        return std::nullopt;
+    options["Hash"] << Option(16, 1, MaxHashMB, [this](const Option&) -> std::optional<std::string> {
+        return apply_memory_budget(true);
+    });
+
+    options["MemoryBudget"] << Option(0, 0, MaxHashMB, [this](const Option&) -> std::optional<std::string> {
+        auto shrunk = apply_memory_budget();
+        return shrunk ? *shrunk : memory_information_as_string(false);
     });
 
+    options["LargePages"] << Option("thp var off var thp var hugetlb-2M var hugetlb-1G", "thp",
+                                    [this](const Option& o) -> std::optional<std::string> {
+                                        set_large_pages(o == "off"          ? LARGE_PAGES_OFF
+                                                        : o == "hugetlb-2M" ? LARGE_PAGES_2M
+                                                        : o == "hugetlb-1G" ? LARGE_PAGES_1G
+                                                                            : LARGE_PAGES_THP);
+                                        return large_pages_info();
+                                    });
+
     options["Clear Hash"] << Option([this](const Option&) -> std::optional<std::string> {
         search_clear();
         return std::nullopt;
@@ -106,19 +129,47 @@ Engine::Engine(std::string path) :
         options[Util::format_string("CTG/BIN Book %d File", i + 1)]
           << Option(EMPTY, [this, i](const Option&) -> std::optional<std::string> {
                  init_bookMan(i);
-                 return std::nullopt;
+                 return apply_memory_budget();
              });
         options[Util::format_string("Book %d Width", i + 1)] << Option(1, 1, 20);
         options[Util::format_string("Book %d Depth", i + 1)] << Option(255, 1, 255);
         options[Util::format_string("(CTG) Book %d Only Green", i + 1)] << Option(true);
     }
-    options["SyzygyPath"] << Option("", [](const Option& o) -> std::optional<std::string> {
+    if (HasSliderBackends)
+        options["SliderAttacks"] << Option("Auto var Auto var Magic var Pext var Compact", "Auto",
+                                           [](const Option& o) -> std::optional<std::string> {
+                                               SliderBackend sb = o == "Magic" ? SLIDER_MAGIC
+                                                                : o == "Pext"  ? SLIDER_PEXT
+                                                                : o == "Compact"
+                                                                  ? SLIDER_COMPACT
+                                                                  : Bitboards::default_slider_backend();
+
+                                               if (!Bitboards::set_slider_backend(sb))
+                                                   return "Pext slider attacks need a BMI2 build";
+
+                                               return std::nullopt;
+                                           });
+    options["SyzygyPath"] << Option("", [this](const Option& o) -> std::optional<std::string> {
         Tablebases::init(o);
-        return std::nullopt;
+        return apply_memory_budget();
     });
     options["SyzygyProbeDepth"] << Option(1, 1, 100);
     options["Syzygy50MoveRule"] << Option(true);
     options["SyzygyProbeLimit"] << Option(7, 0, 7);
+    options["SyzygyCache"] << Option(16, 0, 1024, [this](const Option&) -> std::optional<std::string> {
+        return apply_memory_budget();
+    });
+    options["SyzygyPrefetch"] << Option(256, 0, 65536);
+    options["SyzygyPinned"] << Option("", [this](const Option&) -> std::optional<std::string> {
+        Tablebases::set_pinned(options["SyzygyPinned"], options["SyzygyPinnedDecode"]);
+        Tablebases::init(options["SyzygyPath"], false);
+        return apply_memory_budget();
+    });
+    options["SyzygyPinnedDecode"] << Option(0, 0, 65536, [this](const Option&) -> std::optional<std::string> {
+        Tablebases::set_pinned(options["SyzygyPinned"], options["SyzygyPinnedDecode"]);
+        Tablebases::init(options["SyzygyPath"], false);
+        return apply_memory_budget();
+    });
     options["EvalFile"] << Option(EvalFileDefaultNameBig, [this](const Option& o) -> std::optional<std::string> {
         load_big_network(o);
         return std::nullopt;
@@ -137,7 +188,7 @@ Engine::Engine(std::string path) :
                                                 {
                                                     LD.set_learning_mode(options, o);
                                                 }
-                                                return std::nullopt;
+                                                return apply_memory_budget();
                                             });
 
     options["SmartMultiPVMode"] << Option(false);	
@@ -157,14 +208,36 @@ Engine::Engine(std::string path) :
                                  });
     options["Concurrent Experience"]
       << Option(false);  //for a same experience file on a same folder
+    Tablebases::set_cache_size(options["SyzygyCache"]);
     load_networks();
     resize_threads();
 }
 
 std::uint64_t Engine::perft(const std::string& fen, Depth depth, bool isChess960) {
     verify_networks();
+    wait_for_search_finished();
 
-    return Benchmark::perft(fen, depth, isChess960);
+    // The perft table is sized like the transposition table, which is left untouched,
+    // up to PerftTable::MaxMbSize
+    return Benchmark::perft(fen, depth, isChess960, threads, options["Hash"]);
+}
+
+bool Engine::perft960(Depth chess960Depth, Depth dfrcDepth) {
+    wait_for_search_finished();
+
+    return Benchmark::perft960(chess960Depth, dfrcDepth, threads, options["Hash"]);
+}
+
+std::string Engine::tb_stress(size_t threadCount, int ms) {
+    wait_for_search_finished();
+
+    return Tablebases::stress_test(threadCount, ms);
+}
+
+std::string Engine::tb_probe(const std::string& input, const std::string& output) {
+    wait_for_search_finished();
+
+    return Tablebases::probe_file(input, output, threads);
 }
 
 void Engine::go(Search::LimitsType& limits) {
@@ -183,7 +256,7 @@ void Engine::search_clear() {
     threads.clear();
 
     // @TODO wont work with multiple instances
-    Tablebases::init(options["SyzygyPath"]);  // Free mapped files
+    Tablebases::init(options["SyzygyPath"], false);  // Free mapped files
 }
 
 void Engine::set_on_update_no_moves(std::function<void(const Engine::InfoShort&)>&& f) {
@@ -241,14 +314,22 @@ void Engine::set_position(const std::string& fen, const std::vector<std::string>
 // modifiers
 
 void Engine::set_numa_config_from_option(const std::string& o) {
-    if (o == "auto" || o == "system")
+    // Networks replicated per L3 domain need the threads bound per L3 domain,
+    // the other policies keep their replicas per NUMA node.
+    const bool l3Replicas = options["NumaReplication"] == "l3";
+
+    if (o == "auto" || o == "system" || o == "hardware")
     {
-        numaContext.set_numa_config(NumaConfig::from_system());
+        // Don't respect affinity set in the system for "hardware".
+        NumaConfig cfg = NumaConfig::from_system(o != "hardware");
+
+        numaContext.set_numa_config(
+          l3Replicas ? cfg.split_by_topology(CpuTopology::from_sysfs(), true, true) : std::move(cfg));
     }
-    else if (o == "hardware")
+    else if (o == "fast" || o == "l3")
     {
-        // Don't respect affinity set in the system.
-        numaContext.set_numa_config(NumaConfig::from_system(false));
+        numaContext.set_numa_config(NumaConfig::from_system().split_by_topology(
+          CpuTopology::from_sysfs(), o == "l3", o == "l3" && l3Replicas));
     }
     else if (o == "none")
     {
@@ -260,24 +341,120 @@ void Engine::set_numa_config_from_option(const std::string& o) {
     }
 
     // Force reallocation of threads in case affinities need to change.
-    resize_threads();
+    resize_threads(true);
 }
 
-void Engine::resize_threads() {
+// Threads keep their worker when only their number changes. When they are all
+// rebuilt, the hash is reallocated too, so that it is placed by the new threads.
+void Engine::resize_threads(bool rebuild) {
     threads.wait_for_search_finished();
     threads.set(numaContext.get_numa_config(), {bookMan, options, threads, tt, networks},
-                updateContext);
+                updateContext, rebuild);
 
-    // Reallocate the hash with the new threadpool size
-    set_tt_size(options["Hash"]);
+    apply_memory_budget(rebuild);
 }
 void Engine::init_bookMan(int bookIndex) { bookMan.init(bookIndex, options); }
 
+// Reallocates the transposition table, the network weights and the thread
+// workers with the new backend. Books and experience files use it when loaded.
+void Engine::set_large_pages(LargePagesBackend backend) {
+    wait_for_search_finished();
+    set_large_pages_backend(backend);
+
+    networks.modify_and_replicate([](NN::Networks& networks_) {
+        NN::Networks copy(networks_);
+        networks_ = std::move(copy);
+    });
+
+    resize_threads(true);
+}
+
 void Engine::set_tt_size(size_t mb) {
     wait_for_search_finished();
     tt.resize(mb, threads);
 }
 
+// Returns the sizes in MB of the transposition table and of the tablebase WDL
+// cache. With a "MemoryBudget" they shrink in proportion to their requested
+// sizes so that the engine fits the budget. The rest of the memory cannot
+// shrink, when it alone exceeds the budget the hash keeps 1 MB.
+std::pair<size_t, size_t> Engine::fit_memory_budget() const {
+    const uint64_t budgetMb = size_t(options["MemoryBudget"]);
+    uint64_t       hashMb   = size_t(options["Hash"]);
+    uint64_t       cacheMb  = size_t(options["SyzygyCache"]);
+
+    if (!budgetMb)
+        return {hashMb, cacheMb};
+
+    uint64_t fixed = 0;
+    for (const auto& [name, bytes] : memory_footprint())
+        fixed += bytes;
+
+    fixed -= tt.memory_size() + Tablebases::memory_usage().caches;
+
+    // The caches are only allocated when some tables are found, and a fixed size
+    // DTZ cache comes with the WDL cache.
+    auto cache_mb = [](uint64_t mb) { return Tablebases::cache_memory_size(mb) >> 20; };
+
+    const uint64_t fixedMb   = (fixed + (1 << 20) - 1) >> 20;
+    const uint64_t freeMb    = budgetMb > fixedMb ? budgetMb - fixedMb : 0;
+    const uint64_t requested = hashMb + cache_mb(cacheMb);
+
+    if (requested > freeMb)
+    {
+        hashMb  = std::max(hashMb * freeMb / requested, uint64_t(1));
+        cacheMb = Tablebases::MaxCardinality ? cacheMb * freeMb / requested : cacheMb;
+
+        while (hashMb > 1 && hashMb + cache_mb(cacheMb) > freeMb)
+            --hashMb;
+    }
+
+    return {hashMb, cacheMb};
+}
+
+// Resizes the transposition table and the tablebase cache to fit the memory
+// budget. The table is only reallocated when its size changes, unless asked.
+// Returns a message naming the sizes that were reduced, and telling when the
+// budget cannot be met even so.
+std::optional<std::string> Engine::apply_memory_budget(bool reallocateTT) {
+    wait_for_search_finished();
+
+    const auto [hashMb, cacheMb] = fit_memory_budget();
+    const size_t budgetMb        = options["MemoryBudget"];
+    std::string  reduced;
+
+    if (reallocateTT || tt.memory_size() != hashMb << 20)
+        set_tt_size(hashMb);
+
+    if (Tablebases::cache_size() != cacheMb)
+        Tablebases::set_cache_size(cacheMb);
+
+    if (hashMb < size_t(options["Hash"]))
+        reduced = "Hash set to " + std::to_string(hashMb) + " MB";
+
+    if (cacheMb < size_t(options["SyzygyCache"]))
+        reduced += (reduced.empty() ? "" : " and ") + std::string("SyzygyCache set to ")
+                 + std::to_string(cacheMb) + " MB";
+
+    uint64_t total = 0;
+    for (const auto& [name, bytes] : memory_footprint())
+        total += bytes;
+
+    const bool met = !budgetMb || total <= budgetMb << 20;
+
+    if (reduced.empty() && met)
+        return std::nullopt;
+
+    std::string message = reduced.empty() ? "" : reduced + " to fit the memory budget\n";
+
+    if (!met)
+        message += "The memory budget of " + std::to_string(budgetMb)
+                 + " MB cannot be met, the memory used besides the transposition table and the"
+                   " tablebase cache already exceeds it\n";
+
+    return message + memory_information_as_string(false);
+}
+
 void Engine::set_ponderhit(bool b) { threads.main_manager()->ponder = b; }
 
 // network related
@@ -319,7 +496,10 @@ void Engine::save_network(const std::pair<std::optional<std::string>, std::strin
 void Engine::trace_eval() const {
     StateListPtr trace_states(new std::deque<StateInfo>(1));
     Position     p;
-    p.set(pos.fen(), options["UCI_Chess960"], &trace_states->back());
+    if (pos.packable())
+        p.decode(pos.encode(), &trace_states->back());
+    else
+        p.set(pos.fen(), pos.is_chess960(), &trace_states->back());
 
     verify_networks();
 
@@ -354,6 +534,10 @@ std::vector<std::pair<size_t, size_t>> Engine::get_bound_thread_count_by_numa_no
     return ratios;
 }
 
+std::pair<size_t, size_t> Engine::get_network_replication() const {
+    return {networks.num_replicas(), networks.num_replicas() * networks->memory_size()};
+}
+
 std::string Engine::get_numa_config_as_string() const {
     return numaContext.get_numa_config().to_string();
 }
@@ -363,6 +547,50 @@ std::string Engine::numa_config_information_as_string() const {
     return "Available processors: " + cfgStr;
 }
 
+// Shows how the topology policies would split the processors and bind the given
+// number of threads. A sysfs root other than the system one is not checked
+// against the process affinity, so that a copied tree can be inspected.
+std::string Engine::numa_topology_information_as_string(const std::string& sysfs,
+                                                        size_t             numThreads) const {
+    const bool        isSystem = sysfs == "/sys/devices";
+    const NumaConfig  cfg      = NumaConfig::from_system(isSystem, sysfs);
+    const CpuTopology topology = CpuTopology::from_sysfs(sysfs);
+    std::stringstream ss;
+
+    size_t fastCpus = 0;
+    if (topology.is_hybrid())
+    {
+        size_t highest = 0;
+        for (auto&& [cpu, capacity] : topology.capacityByCpu)
+            highest = std::max(highest, capacity);
+        for (auto&& [cpu, capacity] : topology.capacityByCpu)
+            fastCpus += capacity == highest;
+    }
+
+    ss << "Processors: " << cfg.num_cpus() << ", NUMA nodes " << cfg.num_numa_nodes()
+       << ", L3 domains " << topology.num_l3_domains() << ", fast processors " << fastCpus;
+
+    for (const std::string policy : {"fast", "l3"})
+    {
+        const NumaConfig split = cfg.split_by_topology(topology, policy == "l3");
+        const auto       ns    = split.distribute_threads_among_numa_nodes(numThreads);
+
+        ss << "\nPolicy " << policy << ": " << split.to_string() << ", " << numThreads
+           << (numThreads > 1 ? " threads" : " thread") << " bound ";
+
+        for (NumaIndex n = 0; n < split.num_numa_nodes(); ++n)
+            ss << (n ? ":" : "") << std::count(ns.begin(), ns.end(), n) << "/"
+               << split.num_cpus_in_numa_node(n);
+
+        ss << ", " << split.num_replicas() << (split.num_replicas() > 1 ? " replicas" : " replica");
+    }
+
+    const NumaIndex l3Replicas = cfg.split_by_topology(topology, true, true).num_replicas();
+    ss << "\nReplication l3: " << l3Replicas << (l3Replicas > 1 ? " replicas" : " replica");
+
+    return ss.str();
+}
+
 std::string Engine::thread_binding_information_as_string() const {
     auto              boundThreadsByNode = get_bound_thread_count_by_numa_node();
     std::stringstream ss;
@@ -388,4 +616,120 @@ std::string Engine::thread_binding_information_as_string() const {
     return ss.str();
 }
 
+
+// Reports on which NUMA nodes the pages of the transposition table and of the
+// thread workers, with their histories, are placed. The workers are grouped by
+// the node their thread is bound to. With the "fast" and "l3" policies it is a
+// domain split from a NUMA node, reported along with that node.
+std::string Engine::numa_placement_information_as_string() const {
+    std::stringstream ss;
+
+    auto print = [&ss](const std::vector<size_t>& counts) {
+        size_t total = 0;
+        for (size_t c : counts)
+            total += c;
+
+        if (!total)
+            ss << " unknown";
+
+        for (size_t n = 0; total && n < counts.size(); ++n)
+            if (counts[n])
+                ss << " node " << n << " " << counts[n] * 100 / total << "%";
+    };
+
+    const NumaConfig&                        cfg   = numaContext.get_numa_config();
+    const bool                               bound = !get_bound_thread_count_by_numa_node().empty();
+    std::map<NumaIndex, std::vector<size_t>> workerPages;
+
+    for (auto it = threads.cbegin(); it != threads.cend(); ++it)
+    {
+        const auto counts = pages_per_numa_node((*it)->worker.get(), sizeof(Search::Worker));
+        auto&      pages  = workerPages[bound ? (*it)->numa_node() : 0];
+
+        pages.resize(std::max(pages.size(), counts.size()));
+        for (size_t n = 0; n < counts.size(); ++n)
+            pages[n] += counts[n];
+    }
+
+    ss << "Memory placement on sampled pages\nTransposition table:";
+    print(tt.numa_placement());
+
+    for (const auto& [node, pages] : workerPages)
+    {
+        ss << "\nThread workers";
+        if (bound && cfg.is_split())
+            ss << " bound to domain " << node << " of node " << cfg.system_node_of(node);
+        else if (bound)
+            ss << " bound to node " << node;
+        ss << ":";
+        print(pages);
+    }
+
+    return ss.str();
+}
+
+// Memory held by each subsystem, in bytes. The accumulator caches are part of
+// the thread workers but reported apart. Files mapped by the tablebases and the
+// CTG books are not included: they live in the page cache, shared with other
+// processes, and are reported apart by memory_information_as_string().
+std::vector<std::pair<std::string, size_t>> Engine::memory_footprint() const {
+    const auto   tb          = Tablebases::memory_usage();
+    const size_t threadCount = threads.size();
+    const size_t caches      = threadCount * sizeof(NN::AccumulatorCaches);
+
+    return {{"Transposition table", tt.memory_size()},
+            {"Thread workers", threadCount * sizeof(Search::Worker) - caches},
+            {"Accumulator caches", caches},
+            {"Networks", networks.num_replicas() * networks->memory_size()},
+            {"Experience", LD.memory_size()},
+            {"Books", bookMan.memory_size()},
+            {"Tablebases", tb.tables + tb.caches + tb.pinned}};
+}
+
+// Reports the memory footprint of the engine, on one line or with a line per
+// subsystem for the "memory" command.
+std::string Engine::memory_information_as_string(bool detailed) const {
+    std::stringstream ss;
+
+    const auto   footprint = memory_footprint();
+    const size_t budgetMb  = options["MemoryBudget"];
+    const size_t mapped    = Tablebases::memory_usage().mapped + bookMan.mapped_size();
+    size_t       total     = 0;
+
+    for (const auto& [name, bytes] : footprint)
+        total += bytes;
+
+    ss << "Memory " << Util::format_bytes(total, 1);
+
+    if (budgetMb)
+        ss << " of a " << budgetMb << " MB budget";
+
+    if (!detailed)
+    {
+        const char* separator = ": ";
+
+        for (const auto& [name, bytes] : footprint)
+            if (bytes)
+            {
+                ss << separator << name << " " << Util::format_bytes(bytes, 1);
+                separator = ", ";
+            }
+
+        return ss.str();
+    }
+
+    for (const auto& [name, bytes] : footprint)
+        ss << "\n" << std::left << std::setw(22) << name << std::right << std::setw(12)
+           << Util::format_bytes(bytes, 1);
+
+    ss << "\nNetworks in " << networks.num_replicas()
+       << (networks.num_replicas() > 1 ? " replicas, " : " replica, ") << threads.size()
+       << (threads.size() > 1 ? " threads" : " thread")
+       << "\nMapped files " << Util::format_bytes(mapped, 1)
+       << " of tablebases and books, shared through the page cache\n"
+       << large_pages_info();
+
+    return ss.str();
+}
+
 }
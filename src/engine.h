@@ -28,6 +28,7 @@
 #include <utility>
 #include <vector>
 
+#include "memory.h"
 #include "nnue/network.h"
 #include "position.h"
 #include "search.h"
@@ -57,6 +58,9 @@ class Engine {
     ~Engine() { wait_for_search_finished(); }
 
     std::uint64_t perft(const std::string& fen, Depth depth, bool isChess960);
+    bool          perft960(Depth chess960Depth, Depth dfrcDepth);
+    std::string   tb_stress(size_t threadCount, int ms);
+    std::string   tb_probe(const std::string& input, const std::string& output);
 
     // non blocking call to start searching
     void go(Search::LimitsType&);
@@ -71,9 +75,11 @@ class Engine {
     // modifiers
 
     void set_numa_config_from_option(const std::string& o);
-    void resize_threads();
+    void resize_threads(bool rebuild = false);
     void init_bookMan(int bookIndex);
     void set_tt_size(size_t mb);
+    std::optional<std::string> apply_memory_budget(bool reallocateTT = false);
+    void set_large_pages(LargePagesBackend backend);
     void set_ponderhit(bool);
     void search_clear();
 
@@ -102,11 +108,19 @@ class Engine {
     std::string       visualize() const;
     void              show_moves_bookMan(const Position& position);
     std::vector<std::pair<size_t, size_t>> get_bound_thread_count_by_numa_node() const;
+    std::pair<size_t, size_t>              get_network_replication() const;
     std::string                            get_numa_config_as_string() const;
     std::string                            numa_config_information_as_string() const;
     std::string                            thread_binding_information_as_string() const;
+    std::string numa_topology_information_as_string(const std::string& sysfs,
+                                                    size_t             numThreads) const;
+    std::string                            numa_placement_information_as_string() const;
+    std::string                            memory_information_as_string(bool detailed) const;
     Position                               pos;
    private:
+    std::vector<std::pair<std::string, size_t>> memory_footprint() const;
+    std::pair<size_t, size_t>                   fit_memory_budget() const;
+
     const std::string binaryDirectory;
 
     NumaReplicationContext numaContext;
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include "../memory.h"
 #include "../misc.h"
 #include "learn.h"
 
@@ -9,6 +10,9 @@ using namespace Hypnos;
 LearningData LD;
 
 namespace {
+//New moves are allocated in buffers of 2MB, which are only freed all at once
+constexpr size_t NewMovesPerBuffer = 2 * 1024 * 1024 / sizeof(PersistedLearningMove);
+
 LearningMode identify_learning_mode(const std::string& lm) {
     if (lm == "Off")
         return LearningMode::Off;
@@ -40,7 +44,7 @@ bool LearningData::load(const std::string& filename) {
     }
 
     //Allocate buffer to read the entire file
-    void* fileData = malloc(fileSize);
+    void* fileData = aligned_large_pages_alloc(fileSize);
     if (!fileData)
     {
         std::cerr << "info string Failed to allocate <" << fileSize
@@ -53,7 +57,7 @@ bool LearningData::load(const std::string& filename) {
     in.read((char*) fileData, fileSize);
     if (!in)
     {
-        free(fileData);
+        aligned_large_pages_free(fileData);
 
         std::cerr << "info string Failed to read <" << fileSize << "> bytes from experience file <"
                   << filename << ">" << std::endl;
@@ -65,6 +69,7 @@ bool LearningData::load(const std::string& filename) {
 
     //Save pointer to fileData to be freed later
     mainDataBuffers.push_back(fileData);
+    mainDataSize += fileSize;
 
     //Loop the moves from this file
     bool                   qLearning             = (learningMode == LearningMode::Self);
@@ -174,7 +179,9 @@ LearningData::LearningData() :
     isPaused(false),
     isReadOnly(false),
     needPersisting(false),
-    learningMode(LearningMode::Standard) {}
+    learningMode(LearningMode::Standard),
+    mainDataSize(0),
+    newMovesInLastBuffer(0) {}
 
 LearningData::~LearningData() { clear(); }
 
@@ -184,17 +191,19 @@ void LearningData::clear() {
 
     //Release internal data buffers
     for (void* p : mainDataBuffers)
-        free(p);
+        aligned_large_pages_free(p);
 
     //Clear internal data buffers
     mainDataBuffers.clear();
+    mainDataSize = 0;
 
     //Release internal new moves data buffers
     for (void* p : newMovesDataBuffers)
-        free(p);
+        aligned_large_pages_free(p);
 
     //Clear internal new moves data buffers
     newMovesDataBuffers.clear();
+    newMovesInLastBuffer = 0;
 }
 
 void LearningData::init(Hypnos::OptionsMap& o) {
@@ -301,17 +310,29 @@ void LearningData::persist(const Hypnos::OptionsMap& o) {
         tempExperienceFilename = Util::map_path("experience_new.bin");
     }
 
+    //Gather the entries in a chunk of 2MB, written when full. The loaded and new
+    //moves buffers cannot be written as they are, they still hold the replaced moves
+    std::vector<PersistedLearningMove> persistedLearningMoves;
+    persistedLearningMoves.reserve(NewMovesPerBuffer);
+
     std::ofstream outputFile(tempExperienceFilename, std::ofstream::trunc | std::ofstream::binary);
-    PersistedLearningMove persistedLearningMove;
+
+    auto flush = [&]() {
+        outputFile.write((const char*) persistedLearningMoves.data(),
+                         persistedLearningMoves.size() * sizeof(PersistedLearningMove));
+        persistedLearningMoves.clear();
+    };
+
     for (auto& kvp : HT)
-    {
-        persistedLearningMove.key          = kvp.first;
-        persistedLearningMove.learningMove = *kvp.second;
-        if (persistedLearningMove.learningMove.depth != 0)
+        if (kvp.second->depth != 0)
         {
-            outputFile.write((char*) &persistedLearningMove, sizeof(persistedLearningMove));
+            persistedLearningMoves.push_back({kvp.first, *kvp.second});
+
+            if (persistedLearningMoves.size() == NewMovesPerBuffer)
+                flush();
         }
-    }
+
+    flush();
     outputFile.close();
 
     remove(experienceFilename.c_str());
@@ -326,17 +347,27 @@ void LearningData::pause() { isPaused = true; }
 void LearningData::resume() { isPaused = false; }
 
 void LearningData::add_new_learning(Key key, const LearningMove& lm) {
-    //Allocate buffer to read the entire file
-    PersistedLearningMove* newPlm = (PersistedLearningMove*) malloc(sizeof(PersistedLearningMove));
-    if (!newPlm)
+    //Allocate a new buffer when the last one is full
+    if (newMovesDataBuffers.empty() || newMovesInLastBuffer == NewMovesPerBuffer)
     {
-        std::cerr << "info string Failed to allocate <" << sizeof(PersistedLearningMove)
-                  << "> bytes for new learning entry" << std::endl;
-        return;
+        void* newMovesData =
+          aligned_large_pages_alloc(NewMovesPerBuffer * sizeof(PersistedLearningMove));
+        if (!newMovesData)
+        {
+            std::cerr << "info string Failed to allocate <"
+                      << NewMovesPerBuffer * sizeof(PersistedLearningMove)
+                      << "> bytes for new learning entries" << std::endl;
+            return;
+        }
+
+        //Save pointer to newMovesData to be freed later
+        newMovesDataBuffers.push_back(newMovesData);
+        newMovesInLastBuffer = 0;
     }
 
-    //Save pointer to fileData to be freed later
-    newMovesDataBuffers.push_back(newPlm);
+    //Take the next entry of the last buffer
+    PersistedLearningMove* newPlm =
+      (PersistedLearningMove*) newMovesDataBuffers.back() + newMovesInLastBuffer++;
 
     //Assign
     newPlm->key          = key;
@@ -346,6 +377,13 @@ void LearningData::add_new_learning(Key key, const LearningMove& lm) {
     insert_or_update(newPlm, learningMode == LearningMode::Self);
 }
 
+//Bytes of the loaded files, of the new moves and an estimate for the hash table
+size_t LearningData::memory_size() const {
+    return mainDataSize + newMovesDataBuffers.size() * NewMovesPerBuffer * sizeof(PersistedLearningMove)
+         + HT.size() * (sizeof(decltype(HT)::value_type) + 2 * sizeof(void*))
+         + HT.bucket_count() * sizeof(void*);
+}
+
 int LearningData::probeByMaxDepthAndScore(Key key, const LearningMove*& learningMove) {
     LearningMove* maxDepthMove = nullptr;
     int           maxDepth     = -1;
@@ -33,6 +33,8 @@ class LearningData {
     std::unordered_multimap<Hypnos::Key, LearningMove*> HT;
     std::vector<void*>                                      mainDataBuffers;
     std::vector<void*>                                      newMovesDataBuffers;
+    size_t                                                  mainDataSize;
+    size_t                                                  newMovesInLastBuffer;
 
    private:
     bool load(const std::string& filename);
@@ -59,6 +61,8 @@ class LearningData {
 
     void add_new_learning(Hypnos::Key key, const LearningMove& lm);
 
+    size_t memory_size() const;
+
     int probeByMaxDepthAndScore(Hypnos::Key key, const LearningMove*& learningMove);
     const LearningMove* probe_move(Hypnos::Key key, Hypnos::Move move);
 };
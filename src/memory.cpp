@@ -19,6 +19,11 @@
 #include "memory.h"
 
 #include <cstdlib>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
 
 #if __has_include("features.h")
     #include <features.h>
@@ -26,6 +31,8 @@
 
 #if defined(__linux__) && !defined(__ANDROID__)
     #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) \
@@ -66,6 +73,76 @@ using AdjustTokenPrivileges_t =
 
 namespace Hypnos {
 
+namespace {
+
+// Kinds of memory actually obtained by aligned_large_pages_alloc()
+enum PageKind {
+    REGULAR_PAGES,
+    THP_ADVISED,
+    HUGE_PAGES_2M,
+    HUGE_PAGES_1G,
+    PAGE_KIND_NB
+};
+
+struct Allocation {
+    size_t   size;
+    PageKind kind;
+    bool     mapped;  // Obtained with mmap(), to be freed with munmap()
+};
+
+// The live allocations of 2MB or more, needed to free the mapped memory with
+// munmap() and to report what was obtained. Large blocks are few, a lock is
+// enough. Smaller blocks come from the heap and are not tracked.
+struct Registry {
+    std::mutex                            mutex;
+    std::unordered_map<void*, Allocation> allocations;
+    size_t                                fallbacks = 0;
+};
+
+constexpr size_t LargeBlockSize = 2 * 1024 * 1024;
+
+std::atomic<LargePagesBackend> Backend{LARGE_PAGES_THP};
+
+// Never destroyed, global objects may free their memory at exit
+Registry& registry() {
+    static Registry* r = new Registry;
+    return *r;
+}
+
+void* track(void* mem, size_t size, PageKind kind, bool mapped = false) {
+
+    if (mem)
+    {
+        std::scoped_lock<std::mutex> lock(registry().mutex);
+        registry().allocations[mem] = {size, kind, mapped};
+    }
+    return mem;
+}
+
+Allocation untrack(void* mem) {
+
+    std::scoped_lock<std::mutex> lock(registry().mutex);
+
+    auto& allocations = registry().allocations;
+    auto  it          = allocations.find(mem);
+
+    if (it == allocations.end())
+        return {0, REGULAR_PAGES, false};
+
+    const Allocation a = it->second;
+    allocations.erase(it);
+    return a;
+}
+
+void fall_back() {
+    std::scoped_lock<std::mutex> lock(registry().mutex);
+    registry().fallbacks++;
+}
+
+LargePagesBackend current_backend() { return Backend.load(std::memory_order_relaxed); }
+
+}  // namespace
+
 // Wrappers for systems where the c++17 implementation does not guarantee the
 // availability of aligned_alloc(). Memory allocated with std_aligned_alloc()
 // must be freed with std_aligned_free().
@@ -181,33 +258,134 @@ static void* aligned_large_pages_alloc_windows([[maybe_unused]] size_t allocSize
 
 void* aligned_large_pages_alloc(size_t allocSize) {
 
-    // Try to allocate large pages
-    void* mem = aligned_large_pages_alloc_windows(allocSize);
+    // Try to allocate large pages, Windows has a single large page size
+    if (current_backend() != LARGE_PAGES_OFF)
+    {
+        if (void* mem = aligned_large_pages_alloc_windows(allocSize))
+            return track(mem, allocSize, HUGE_PAGES_2M);
+
+        fall_back();
+    }
 
     // Fall back to regular, page-aligned, allocation if necessary
-    if (!mem)
-        mem = VirtualAlloc(nullptr, allocSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    void* mem = VirtualAlloc(nullptr, allocSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
 
-    return mem;
+    return track(mem, allocSize, REGULAR_PAGES);
 }
 
 #else
 
+    #if defined(__linux__) && defined(MAP_HUGETLB)
+        #ifndef MAP_HUGE_SHIFT
+            #define MAP_HUGE_SHIFT 26
+        #endif
+
+// Maps anonymous memory from the hugetlbfs pool, with pages of 1 << log2Page
+// bytes. Fails when the pool has not enough free pages of that size.
+static void* mmap_huge_pages(size_t size, int log2Page) {
+
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (log2Page << MAP_HUGE_SHIFT), -1, 0);
+
+    return mem == MAP_FAILED ? nullptr : mem;
+}
+    #endif
+
+    #if defined(__linux__) && defined(MAP_ANONYMOUS)
+// Maps fresh anonymous pages rather than reusing heap memory, so that each page
+// is placed on the NUMA node of the thread that touches it first. The mapping
+// is trimmed to start at a multiple of the alignment.
+static void* mmap_aligned(size_t size, size_t alignment) {
+
+    const size_t mapSize = size + alignment;
+    void* mem = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mem == MAP_FAILED)
+        return nullptr;
+
+    const uintptr_t start   = uintptr_t(mem);
+    const uintptr_t aligned = (start + alignment - 1) & ~uintptr_t(alignment - 1);
+
+    if (aligned > start)
+        munmap(mem, aligned - start);
+
+    if (start + mapSize > aligned + size)
+        munmap((void*) (aligned + size), start + mapSize - (aligned + size));
+
+    return (void*) aligned;
+}
+    #endif
+
 void* aligned_large_pages_alloc(size_t allocSize) {
 
+    const LargePagesBackend backend = current_backend();
+
+    #if defined(__linux__) && defined(MAP_HUGETLB)
+    constexpr size_t Page1G = size_t(1) << 30;
+    constexpr size_t Page2M = size_t(1) << 21;
+
+    // A 1GB page is used only when at least half of it is needed
+    if (backend == LARGE_PAGES_1G && allocSize >= Page1G / 2)
+    {
+        const size_t size = (allocSize + Page1G - 1) / Page1G * Page1G;
+
+        if (void* mem = mmap_huge_pages(size, 30))
+            return track(mem, size, HUGE_PAGES_1G, true);
+
+        fall_back();
+    }
+
+    if (backend >= LARGE_PAGES_2M)
+    {
+        const size_t size = (allocSize + Page2M - 1) / Page2M * Page2M;
+
+        if (void* mem = mmap_huge_pages(size, 21))
+            return track(mem, size, HUGE_PAGES_2M, true);
+
+        fall_back();
+    }
+    #endif
+
     #if defined(__linux__)
-    constexpr size_t alignment = 2 * 1024 * 1024;  // 2MB page size assumed
+    const size_t alignment = backend != LARGE_PAGES_OFF ? 2 * 1024 * 1024  // 2MB page size assumed
+                                                        : 4096;
     #else
     constexpr size_t alignment = 4096;  // small page size assumed
     #endif
 
     // Round up to multiples of alignment
     size_t size = ((allocSize + alignment - 1) / alignment) * alignment;
-    void*  mem  = std_aligned_alloc(alignment, size);
+
+    // Only large blocks are tracked. On Linux they are mapped apart, so that
+    // their pages are placed on the NUMA node of the thread touching them first.
+    const bool large = allocSize >= LargeBlockSize;
+
+    #if defined(__linux__) && defined(MAP_ANONYMOUS)
+    void*      mem    = large ? mmap_aligned(size, alignment) : std_aligned_alloc(alignment, size);
+    const bool mapped = large;
+    #else
+    void*      mem    = std_aligned_alloc(alignment, size);
+    const bool mapped = false;
+    #endif
+
+    if (!mem)
+        return nullptr;
+
+    PageKind kind = REGULAR_PAGES;
+
     #if defined(MADV_HUGEPAGE)
-    madvise(mem, size, MADV_HUGEPAGE);
+    if (backend != LARGE_PAGES_OFF)
+    {
+        madvise(mem, size, MADV_HUGEPAGE);
+        kind = THP_ADVISED;
+    }
     #endif
-    return mem;
+    #if defined(MADV_NOHUGEPAGE)
+    if (backend == LARGE_PAGES_OFF)
+        madvise(mem, size, MADV_NOHUGEPAGE);
+    #endif
+
+    return large ? track(mem, size, kind, mapped) : mem;
 }
 
 #endif
@@ -220,6 +398,9 @@ void* aligned_large_pages_alloc(size_t allocSize) {
 
 void aligned_large_pages_free(void* mem) {
 
+    if (mem)
+        untrack(mem);
+
     if (mem && !VirtualFree(mem, 0, MEM_RELEASE))
     {
         DWORD err = GetLastError();
@@ -231,7 +412,116 @@ void aligned_large_pages_free(void* mem) {
 
 #else
 
-void aligned_large_pages_free(void* mem) { std_aligned_free(mem); }
+void aligned_large_pages_free(void* mem) {
+
+    if (!mem)
+        return;
+
+    [[maybe_unused]] const Allocation a = untrack(mem);
+
+    #if defined(__linux__) && defined(MAP_ANONYMOUS)
+    if (a.mapped)
+    {
+        munmap(mem, a.size);
+        return;
+    }
+    #endif
+
+    std_aligned_free(mem);
+}
 
 #endif
+
+// Sets the backend of the next allocations, the memory already allocated is
+// left as it is.
+void set_large_pages_backend(LargePagesBackend backend) {
+    Backend.store(backend, std::memory_order_relaxed);
+
+    std::scoped_lock<std::mutex> lock(registry().mutex);
+    registry().fallbacks = 0;
+}
+
+// Reports the memory obtained by the live large page allocations of 2MB or more,
+// by kind of page. Transparent huge pages are only advised, the kernel reports how much
+// anonymous memory it actually backs with them.
+std::string large_pages_info() {
+
+    constexpr const char* Names[] = {"off", "thp", "hugetlb-2M", "hugetlb-1G"};
+
+    size_t            bytes[PAGE_KIND_NB] = {};
+    size_t            fallbacks;
+    LargePagesBackend backend;
+
+    {
+        std::scoped_lock<std::mutex> lock(registry().mutex);
+
+        for (const auto& [mem, a] : registry().allocations)
+            bytes[a.kind] += a.size;
+
+        fallbacks = registry().fallbacks;
+        backend   = current_backend();
+    }
+
+    std::stringstream ss;
+    ss << "Large pages " << Names[backend] << ": " << (bytes[HUGE_PAGES_1G] >> 20)
+       << " MB in 1GB pages, " << (bytes[HUGE_PAGES_2M] >> 20) << " MB in 2MB pages, "
+       << (bytes[THP_ADVISED] >> 20) << " MB advised for transparent huge pages, "
+       << (bytes[REGULAR_PAGES] >> 20) << " MB in regular pages";
+
+    if (fallbacks)
+        ss << ", " << fallbacks << " allocations fell back to smaller pages";
+
+#if defined(__linux__)
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string   key;
+    size_t        kB;
+
+    while (smaps >> key)
+        if (key == "AnonHugePages:" && smaps >> kB)
+        {
+            ss << ", " << (kB >> 10) << " MB of the process backed by transparent huge pages";
+            break;
+        }
+#endif
+
+    return ss.str();
+}
+
+// Queries the node of evenly spaced pages of the block with move_pages(),
+// which only reports the placement when no target node is given. Pages not
+// touched yet have no node and are not counted.
+std::vector<size_t> pages_per_numa_node([[maybe_unused]] const void* mem,
+                                        [[maybe_unused]] size_t      size,
+                                        [[maybe_unused]] size_t      maxSamples) {
+
+    std::vector<size_t> counts;
+
+#if defined(__linux__) && defined(SYS_move_pages)
+    const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    const size_t pages    = (size + pageSize - 1) / pageSize;
+    const size_t samples  = std::min(pages, maxSamples);
+
+    std::vector<void*> addresses(samples);
+    std::vector<int>   status(samples);
+
+    for (size_t i = 0; i < samples; ++i)
+        addresses[i] =
+          (void*) ((uintptr_t(mem) + i * pages / samples * pageSize) & ~uintptr_t(pageSize - 1));
+
+    if (!samples
+        || syscall(SYS_move_pages, 0, samples, addresses.data(), nullptr, status.data(), 0))
+        return counts;
+
+    for (int node : status)
+        if (node >= 0)
+        {
+            if (size_t(node) >= counts.size())
+                counts.resize(node + 1);
+            counts[node]++;
+        }
+#endif
+
+    return counts;
+}
+
 }  // namespace Hypnos
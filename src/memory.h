@@ -24,8 +24,10 @@
 #include <cstdint>
 #include <memory>
 #include <new>
+#include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "types.h"
 
@@ -39,6 +41,24 @@ void* aligned_large_pages_alloc(size_t size);
 						
 void  aligned_large_pages_free(void* mem);
 
+// How aligned_large_pages_alloc() obtains its memory, set by the "LargePages"
+// option. The explicit page sizes are taken from the hugetlbfs pool of Linux,
+// each backend falls back to the next smaller one when the pool is empty.
+enum LargePagesBackend : uint8_t {
+    LARGE_PAGES_OFF,  // Regular pages only
+    LARGE_PAGES_THP,  // Transparent huge pages, requested with madvise()
+    LARGE_PAGES_2M,   // Explicit 2MB pages
+    LARGE_PAGES_1G,   // Explicit 1GB pages, for the blocks of 512MB or more
+    LARGE_PAGES_NB
+};
+
+void        set_large_pages_backend(LargePagesBackend backend);
+std::string large_pages_info();
+
+// Number of sampled pages of a block placed on each NUMA node, empty where
+// the placement cannot be queried.
+std::vector<size_t> pages_per_numa_node(const void* mem, size_t size, size_t maxSamples = 256);
+
 // Frees memory which was placed there with placement new.
 // Works for both single objects and arrays of unknown bound.
 template<typename T, typename FREE_FUNC>
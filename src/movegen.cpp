@@ -47,8 +47,11 @@ ExtMove* make_promotions(ExtMove* moveList, [[maybe_unused]] Square to) {
 }
 
 
-template<Color Us, GenType Type>
-ExtMove* generate_pawn_moves(const Position& pos, ExtMove* moveList, Bitboard target) {
+// Generates the moves of the given pawns. All their destination squares are
+// restricted to the given line, which is used for the pawns pinned to their king.
+template<Color Us, GenType Type, bool Legal>
+ExtMove* generate_pawn_moves(
+  const Position& pos, ExtMove* moveList, Bitboard pawns, Bitboard target, Bitboard line) {
 
     constexpr Color     Them     = ~Us;
     constexpr Bitboard  TRank7BB = (Us == WHITE ? Rank7BB : Rank2BB);
@@ -57,11 +60,11 @@ ExtMove* generate_pawn_moves(const Position& pos, ExtMove* moveList, Bitboard ta
     constexpr Direction UpRight  = (Us == WHITE ? NORTH_EAST : SOUTH_WEST);
     constexpr Direction UpLeft   = (Us == WHITE ? NORTH_WEST : SOUTH_EAST);
 
-    const Bitboard emptySquares = ~pos.pieces();
-    const Bitboard enemies      = Type == EVASIONS ? pos.checkers() : pos.pieces(Them);
+    const Bitboard emptySquares = ~pos.pieces() & line;
+    const Bitboard enemies      = (Type == EVASIONS ? pos.checkers() : pos.pieces(Them)) & line;
 
-    Bitboard pawnsOn7    = pos.pieces(Us, PAWN) & TRank7BB;
-    Bitboard pawnsNotOn7 = pos.pieces(Us, PAWN) & ~TRank7BB;
+    Bitboard pawnsOn7    = pawns & TRank7BB;
+    Bitboard pawnsNotOn7 = pawns & ~TRank7BB;
 
     // Single and double pawn pushes, no promotions
     if constexpr (Type != CAPTURES)
@@ -136,10 +139,14 @@ ExtMove* generate_pawn_moves(const Position& pos, ExtMove* moveList, Bitboard ta
 
             b1 = pawnsNotOn7 & pawn_attacks_bb(Them, pos.ep_square());
 
-            assert(b1);
-
+            // En passant captures can uncover an attack on the king along the
+            // rank of the captured pawn, they are rare enough to use legal().
             while (b1)
-                *moveList++ = Move::make<EN_PASSANT>(pop_lsb(b1), pos.ep_square());
+            {
+                Move m = Move::make<EN_PASSANT>(pop_lsb(b1), pos.ep_square());
+                if (!Legal || pos.legal(m))
+                    *moveList++ = m;
+            }
         }
     }
 
@@ -148,17 +155,22 @@ ExtMove* generate_pawn_moves(const Position& pos, ExtMove* moveList, Bitboard ta
 
 
 template<Color Us, PieceType Pt>
-ExtMove* generate_moves(const Position& pos, ExtMove* moveList, Bitboard target) {
+ExtMove* generate_moves(const Position& pos, ExtMove* moveList, Bitboard target, Bitboard pinned) {
 
     static_assert(Pt != KING && Pt != PAWN, "Unsupported piece type in generate_moves()");
 
-    Bitboard bb = pos.pieces(Us, Pt);
+    // A pinned knight can never move
+    Bitboard bb = pos.pieces(Us, Pt) & ~(Pt == KNIGHT ? pinned : 0);
 
     while (bb)
     {
         Square   from = pop_lsb(bb);
         Bitboard b    = attacks_bb<Pt>(from, pos.pieces()) & target;
 
+        // A pinned piece can only move along the line through its king
+        if (pinned & from)
+            b &= line_bb(pos.square<KING>(Us), from);
+
         while (b)
             *moveList++ = Move(from, pop_lsb(b));
     }
@@ -167,13 +179,16 @@ ExtMove* generate_moves(const Position& pos, ExtMove* moveList, Bitboard target)
 }
 
 
-template<Color Us, GenType Type>
+// Generates the moves of the given type. Unless Legal is set, pins and king
+// safety are not considered and the moves are only pseudo-legal.
+template<Color Us, GenType Type, bool Legal>
 ExtMove* generate_all(const Position& pos, ExtMove* moveList) {
 
     static_assert(Type != LEGAL, "Unsupported type in generate_all()");
 
-    const Square ksq = pos.square<KING>(Us);
-    Bitboard     target;
+    const Square   ksq    = pos.square<KING>(Us);
+    const Bitboard pinned = Legal ? pos.blockers_for_king(Us) & pos.pieces(Us) : 0;
+    Bitboard       target;
 
     // Skip generating non-king moves when in double check
     if (Type != EVASIONS || !more_than_one(pos.checkers()))
@@ -183,36 +198,147 @@ ExtMove* generate_all(const Position& pos, ExtMove* moveList) {
                : Type == CAPTURES     ? pos.pieces(~Us)
                                       : ~pos.pieces();  // QUIETS
 
-        moveList = generate_pawn_moves<Us, Type>(pos, moveList, target);
-        moveList = generate_moves<Us, KNIGHT>(pos, moveList, target);
-        moveList = generate_moves<Us, BISHOP>(pos, moveList, target);
-        moveList = generate_moves<Us, ROOK>(pos, moveList, target);
-        moveList = generate_moves<Us, QUEEN>(pos, moveList, target);
+        // Pinned pawns are generated one at a time, along the line through the king
+        const Bitboard pinnedPawns = pinned & pos.pieces(PAWN);
+
+        moveList = generate_pawn_moves<Us, Type, Legal>(
+          pos, moveList, pos.pieces(Us, PAWN) & ~pinnedPawns, target, ~Bitboard(0));
+
+        for (Bitboard b = pinnedPawns; b;)
+        {
+            Square from = pop_lsb(b);
+            moveList    = generate_pawn_moves<Us, Type, Legal>(pos, moveList, square_bb(from),
+                                                               target, line_bb(ksq, from));
+        }
+
+        moveList = generate_moves<Us, KNIGHT>(pos, moveList, target, pinned);
+        moveList = generate_moves<Us, BISHOP>(pos, moveList, target, pinned);
+        moveList = generate_moves<Us, ROOK>(pos, moveList, target, pinned);
+        moveList = generate_moves<Us, QUEEN>(pos, moveList, target, pinned);
     }
 
     Bitboard b = attacks_bb<KING>(ksq) & (Type == EVASIONS ? ~pos.pieces(Us) : target);
 
+    // The king is removed from the occupancy to see x-ray attacks through it
     while (b)
-        *moveList++ = Move(ksq, pop_lsb(b));
+    {
+        Square to = pop_lsb(b);
+        if (!Legal || !(pos.attackers_to(to, pos.pieces() ^ ksq) & pos.pieces(~Us)))
+            *moveList++ = Move(ksq, to);
+    }
 
     if ((Type == QUIETS || Type == NON_EVASIONS) && pos.can_castle(Us & ANY_CASTLING))
         for (CastlingRights cr : {Us & KING_SIDE, Us & QUEEN_SIDE})
             if (!pos.castling_impeded(cr) && pos.can_castle(cr))
-                *moveList++ = Move::make<CASTLING>(ksq, pos.castling_rook_square(cr));
+            {
+                Move m = Move::make<CASTLING>(ksq, pos.castling_rook_square(cr));
+                if (!Legal || pos.legal(m))
+                    *moveList++ = m;
+            }
 
     return moveList;
 }
 
+
+// Counts the legal moves of the side to move without writing them to a move
+// list. The moves of non-pinned pieces are counted with popcounts of their
+// target sets, pinned pieces are restricted to the line through their king and
+// only the rare en passant and castling moves are verified with Position::legal().
+template<Color Us>
+size_t count_legal(const Position& pos) {
+
+    constexpr Color     Them     = ~Us;
+    constexpr Bitboard  TRank8BB = (Us == WHITE ? Rank8BB : Rank1BB);
+    constexpr Bitboard  TRank3BB = (Us == WHITE ? Rank3BB : Rank6BB);
+    constexpr Direction Up       = pawn_push(Us);
+    constexpr Direction UpRight  = (Us == WHITE ? NORTH_EAST : SOUTH_WEST);
+    constexpr Direction UpLeft   = (Us == WHITE ? NORTH_WEST : SOUTH_EAST);
+
+    // Promotions count once for each of the four promotion piece types
+    const auto count_pawn_moves = [](Bitboard b) {
+        return popcount(b & ~TRank8BB) + 4 * popcount(b & TRank8BB);
+    };
+
+    const Square   ksq          = pos.square<KING>(Us);
+    const Bitboard occupied     = pos.pieces();
+    const Bitboard emptySquares = ~occupied;
+    const Bitboard enemies      = pos.pieces(Them);
+    const Bitboard pinned       = pos.blockers_for_king(Us) & pos.pieces(Us);
+    size_t         cnt          = 0;
+
+    // The king is removed from the occupancy to see x-ray attacks through it
+    Bitboard b = attacks_bb<KING>(ksq) & ~pos.pieces(Us);
+    while (b)
+        cnt += !(pos.attackers_to(pop_lsb(b), occupied ^ ksq) & enemies);
+
+    // Only the king can move when in double check
+    if (more_than_one(pos.checkers()))
+        return cnt;
+
+    const Bitboard target =
+      pos.checkers() ? between_bb(ksq, lsb(pos.checkers())) : ~pos.pieces(Us);
+
+    Bitboard pawns = pos.pieces(Us, PAWN) & ~pinned;
+    Bitboard b1    = shift<Up>(pawns) & emptySquares;
+    Bitboard b2    = shift<Up>(b1 & TRank3BB) & emptySquares;
+
+    cnt += count_pawn_moves(b1 & target) + popcount(b2 & target)
+         + count_pawn_moves(shift<UpRight>(pawns) & enemies & target)
+         + count_pawn_moves(shift<UpLeft>(pawns) & enemies & target);
+
+    // A pinned piece can only move along the line through its king. When in
+    // check, this line meets the target only if the piece is behind the checker.
+    pawns = pos.pieces(Us, PAWN) & pinned;
+    while (pawns)
+    {
+        Square from = pop_lsb(pawns);
+
+        b1 = shift<Up>(square_bb(from)) & emptySquares;
+        b2 = shift<Up>(b1 & TRank3BB) & emptySquares;
+        b  = b1 | b2 | (pawn_attacks_bb(Us, from) & enemies);
+
+        cnt += count_pawn_moves(b & target & line_bb(ksq, from));
+    }
+
+    Bitboard pieces = pos.pieces(Us, KNIGHT, BISHOP, ROOK, QUEEN);
+    while (pieces)
+    {
+        Square   from = pop_lsb(pieces);
+        Bitboard mask = pinned & from ? target & line_bb(ksq, from) : target;
+
+        cnt += popcount(attacks_bb(type_of(pos.piece_on(from)), from, occupied) & mask);
+    }
+
+    // An en passant capture cannot resolve a discovered check
+    if (pos.ep_square() != SQ_NONE && !(pos.checkers() && (target & (pos.ep_square() + Up))))
+    {
+        b = pos.pieces(Us, PAWN) & pawn_attacks_bb(Them, pos.ep_square());
+        while (b)
+            cnt += pos.legal(Move::make<EN_PASSANT>(pop_lsb(b), pos.ep_square()));
+    }
+
+    if (!pos.checkers() && pos.can_castle(Us & ANY_CASTLING))
+        for (CastlingRights cr : {Us & KING_SIDE, Us & QUEEN_SIDE})
+            if (!pos.castling_impeded(cr) && pos.can_castle(cr))
+                cnt += pos.legal(Move::make<CASTLING>(ksq, pos.castling_rook_square(cr)));
+
+    return cnt;
+}
+
 }  // namespace
 
 
-// <CAPTURES>     Generates all pseudo-legal captures plus queen promotions
-// <QUIETS>       Generates all pseudo-legal non-captures and underpromotions
-// <EVASIONS>     Generates all pseudo-legal check evasions
-// <NON_EVASIONS> Generates all pseudo-legal captures and non-captures
+// <CAPTURES>     Generates all captures plus queen promotions
+// <QUIETS>       Generates all non-captures and underpromotions
+// <EVASIONS>     Generates all check evasions
+// <NON_EVASIONS> Generates all captures and non-captures
 //
+// With Legal set, pinned pieces are restricted to the line through their king
+// and king moves to unattacked squares, so no move needs to be verified with
+// Position::legal(). Otherwise the moves are pseudo-legal, which is cheaper when
+// the caller stops before verifying most of them, as the MovePicker stages do.
 // Returns a pointer to the end of the move list.
-template<GenType Type>
+template<GenType Type, bool Legal>
 ExtMove* generate(const Position& pos, ExtMove* moveList) {
 
     static_assert(Type != LEGAL, "Unsupported type in generate()");
@@ -220,15 +346,19 @@ ExtMove* generate(const Position& pos, ExtMove* moveList) {
 
     Color us = pos.side_to_move();
 
-    return us == WHITE ? generate_all<WHITE, Type>(pos, moveList)
-                       : generate_all<BLACK, Type>(pos, moveList);
+    return us == WHITE ? generate_all<WHITE, Type, Legal>(pos, moveList)
+                       : generate_all<BLACK, Type, Legal>(pos, moveList);
 }
 
 // Explicit template instantiations
-template ExtMove* generate<CAPTURES>(const Position&, ExtMove*);
-template ExtMove* generate<QUIETS>(const Position&, ExtMove*);
-template ExtMove* generate<EVASIONS>(const Position&, ExtMove*);
-template ExtMove* generate<NON_EVASIONS>(const Position&, ExtMove*);
+template ExtMove* generate<CAPTURES, true>(const Position&, ExtMove*);
+template ExtMove* generate<CAPTURES, false>(const Position&, ExtMove*);
+template ExtMove* generate<QUIETS, true>(const Position&, ExtMove*);
+template ExtMove* generate<QUIETS, false>(const Position&, ExtMove*);
+template ExtMove* generate<EVASIONS, true>(const Position&, ExtMove*);
+template ExtMove* generate<EVASIONS, false>(const Position&, ExtMove*);
+template ExtMove* generate<NON_EVASIONS, true>(const Position&, ExtMove*);
+template ExtMove* generate<NON_EVASIONS, false>(const Position&, ExtMove*);
 
 
 // generate<LEGAL> generates all the legal moves in the given position
@@ -236,21 +366,17 @@ template ExtMove* generate<NON_EVASIONS>(const Position&, ExtMove*);
 template<>
 ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList) {
 
-    Color    us     = pos.side_to_move();
-    Bitboard pinned = pos.blockers_for_king(us) & pos.pieces(us);
-    Square   ksq    = pos.square<KING>(us);
-    ExtMove* cur    = moveList;
+    return pos.checkers() ? generate<EVASIONS>(pos, moveList)
+                          : generate<NON_EVASIONS>(pos, moveList);
+}
 
-    moveList =
-      pos.checkers() ? generate<EVASIONS>(pos, moveList) : generate<NON_EVASIONS>(pos, moveList);
-    while (cur != moveList)
-        if (((pinned & cur->from_sq()) || cur->from_sq() == ksq || cur->type_of() == EN_PASSANT)
-            && !pos.legal(*cur))
-            *cur = *(--moveList);
-        else
-            ++cur;
 
-    return moveList;
+// move_count<LEGAL> counts all the legal moves in the given position. It returns
+// the same as MoveList<LEGAL>(pos).size() without generating any move.
+template<>
+size_t move_count<LEGAL>(const Position& pos) {
+
+    return pos.side_to_move() == WHITE ? count_legal<WHITE>(pos) : count_legal<BLACK>(pos);
 }
 
 }  // namespace Hypnos
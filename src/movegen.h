@@ -48,9 +48,12 @@ struct ExtMove: public Move {
 
 inline bool operator<(const ExtMove& f, const ExtMove& s) { return f.value < s.value; }
 
-template<GenType>
+template<GenType, bool Legal = true>
 ExtMove* generate(const Position& pos, ExtMove* moveList);
 
+template<GenType>
+size_t move_count(const Position& pos);
+
 // The MoveList struct wraps the generate() function and returns a convenient
 // list of moves. Using MoveList is sometimes preferable to directly calling
 // the lower level generate() function.
@@ -93,11 +93,15 @@ MovePicker::MovePicker(const Position&              p,
     ttMove(ttm),
     depth(d) {
 
+    // With legal stages the TT move is the only one that is not generated, so its
+    // legality is verified here and the search never has to call Position::legal().
+    const bool ttMoveOk = ttm && pos.pseudo_legal(ttm) && (!HasLegalStages || pos.legal(ttm));
+
     if (pos.checkers())
-        stage = EVASION_TT + !(ttm && pos.pseudo_legal(ttm));
+        stage = EVASION_TT + !ttMoveOk;
 
     else
-        stage = (depth > 0 ? MAIN_TT : QSEARCH_TT) + !(ttm && pos.pseudo_legal(ttm));
+        stage = (depth > 0 ? MAIN_TT : QSEARCH_TT) + !ttMoveOk;
 }
 
 // MovePicker constructor for ProbCut: we generate captures with Static Exchange
@@ -110,7 +114,8 @@ MovePicker::MovePicker(const Position& p, Move ttm, int th, const CapturePieceTo
     assert(!pos.checkers());
 
     stage = PROBCUT_TT
-          + !(ttm && pos.capture_stage(ttm) && pos.pseudo_legal(ttm) && pos.see_ge(ttm, threshold));
+          + !(ttm && pos.capture_stage(ttm) && pos.pseudo_legal(ttm)
+              && (!HasLegalStages || pos.legal(ttm)) && pos.see_ge(ttm, threshold));
 }
 
 // Assigns a numerical value to each move in a list, used for sorting.
@@ -228,7 +233,7 @@ top:
     case PROBCUT_INIT :
     case QCAPTURE_INIT :
         cur = endBadCaptures = moves;
-        endMoves             = generate<CAPTURES>(pos, cur);
+        endMoves             = generate<CAPTURES, HasLegalStages>(pos, cur);
 
         score<CAPTURES>();
         partial_insertion_sort(cur, endMoves, std::numeric_limits<int>::min());
@@ -250,7 +255,7 @@ top:
         if (!skipQuiets)
         {
             cur      = endBadCaptures;
-            endMoves = beginBadQuiets = endBadQuiets = generate<QUIETS>(pos, cur);
+            endMoves = beginBadQuiets = endBadQuiets = generate<QUIETS, HasLegalStages>(pos, cur);
 
             score<QUIETS>();
             partial_insertion_sort(cur, endMoves, quiet_threshold(depth));
@@ -295,7 +300,7 @@ top:
 
     case EVASION_INIT :
         cur      = moves;
-        endMoves = generate<EVASIONS>(pos, cur);
+        endMoves = generate<EVASIONS, HasLegalStages>(pos, cur);
 
         score<EVASIONS>();
         ++stage;
@@ -142,7 +142,7 @@ using CorrectionHistory =
 // new pseudo-legal move on every call, until there are no moves left, when
 // Move::none() is returned. In order to improve the efficiency of the alpha-beta
 // algorithm, MovePicker attempts to return the moves which are most likely to get
-// a cut-off first.
+// a cut-off first. Built with USE_LEGAL_STAGES, all the emitted moves are legal.
 class MovePicker {
 
     enum PickType {
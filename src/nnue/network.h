@@ -19,6 +19,7 @@
 #ifndef NETWORK_H_INCLUDED
 #define NETWORK_H_INCLUDED
 
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <optional>
@@ -70,6 +71,10 @@ class Network {
                             AccumulatorCaches::Cache<FTDimensions>* cache) const;
 
     void          verify(std::string evalfilePath) const;
+    std::size_t   memory_size() const {
+        return (featureTransformer ? sizeof(Transformer) : 0)
+             + (network ? LayerStacks * sizeof(Arch) : 0);
+    }
     NnueEvalTrace trace_evaluate(const Position&                         pos,
                                  AccumulatorCaches::Cache<FTDimensions>* cache) const;
 
@@ -123,6 +128,8 @@ struct Networks {
         big(std::move(nB)),
         small(std::move(nS)) {}
 
+    std::size_t memory_size() const { return big.memory_size() + small.memory_size(); }
+
     NetworkBig   big;
     NetworkSmall small;
 };
@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
@@ -434,15 +435,49 @@ inline static const auto STARTUP_USE_OLD_AFFINITY_API =
 class NumaReplicatedAccessToken {
    public:
     NumaReplicatedAccessToken() :
-        n(0) {}
+        n(0),
+        r(0) {}
 
     explicit NumaReplicatedAccessToken(NumaIndex idx) :
-        n(idx) {}
+        n(idx),
+        r(idx) {}
+
+    NumaReplicatedAccessToken(NumaIndex idx, NumaIndex replica) :
+        n(idx),
+        r(replica) {}
 
     NumaIndex get_numa_index() const { return n; }
 
+    // Nodes split by processor topology share the replica of their NUMA node
+    NumaIndex get_replica_index() const { return r; }
+
    private:
-    NumaIndex n;
+    NumaIndex n, r;
+};
+
+// Processor topology below the NUMA nodes: the L3 cache domain and the relative
+// capacity of each processor. On hybrid CPUs the performance cores have a higher
+// capacity than the efficiency cores, elsewhere all processors are equal. On
+// Linux it is read from sysfs, whose root can be changed for testing. Processors
+// without information are left out of the maps.
+struct CpuTopology {
+    std::map<CpuIndex, CpuIndex> l3ByCpu;        // L3 domain, named by its lowest processor
+    std::map<CpuIndex, size_t>   capacityByCpu;  // Higher is faster
+
+    bool is_hybrid() const {
+        return std::adjacent_find(capacityByCpu.begin(), capacityByCpu.end(),
+                                  [](const auto& a, const auto& b) { return a.second != b.second; })
+            != capacityByCpu.end();
+    }
+
+    size_t num_l3_domains() const {
+        std::set<CpuIndex> domains;
+        for (auto&& [cpu, l3] : l3ByCpu)
+            domains.insert(l3);
+        return domains.size();
+    }
+
+    static CpuTopology from_sysfs(const std::string& root = "/sys/devices");
 };
 
 // Designed as immutable, because there is no good reason to alter an already
@@ -462,7 +497,8 @@ class NumaConfig {
    public:
     NumaConfig() :
         highestCpuIndex(0),
-        customAffinity(false) {
+        customAffinity(false),
+        fillNodesInOrder(false) {
         const auto numCpus = SYSTEM_THREADS_NB;
         add_cpu_range_to_node(NumaIndex{0}, CpuIndex{0}, numCpus - 1);
     }
@@ -471,7 +507,8 @@ class NumaConfig {
     // On Linux we read from standardized kernel sysfs, with a fallback to single NUMA
     // node. On Windows we utilize GetNumaProcessorNodeEx, which has its quirks, see
     // comment for Windows implementation of get_process_affinity.
-    static NumaConfig from_system([[maybe_unused]] bool respectProcessAffinity = true) {
+    static NumaConfig from_system([[maybe_unused]] bool               respectProcessAffinity = true,
+                                  [[maybe_unused]] const std::string& sysfs = "/sys/devices") {
         NumaConfig cfg = empty();
 
 #if defined(__linux__) && !defined(__ANDROID__)
@@ -497,7 +534,7 @@ class NumaConfig {
         };
 
         // /sys/devices/system/node/online contains information about active NUMA nodes
-        auto nodeIdsStr = read_file_to_string("/sys/devices/system/node/online");
+        auto nodeIdsStr = read_file_to_string(sysfs + "/system/node/online");
         if (!nodeIdsStr.has_value() || nodeIdsStr->empty())
         {
             fallback();
@@ -508,8 +545,7 @@ class NumaConfig {
             for (size_t n : indices_from_shortened_string(*nodeIdsStr))
             {
                 // /sys/devices/system/node/node.../cpulist
-                std::string path =
-                  std::string("/sys/devices/system/node/node") + std::to_string(n) + "/cpulist";
+                std::string path = sysfs + "/system/node/node" + std::to_string(n) + "/cpulist";
                 auto cpuIdsStr = read_file_to_string(path);
                 // Now, we only bail if the file does not exist. Some nodes may be
                 // empty, that's fine. An empty node still has a file that appears
@@ -672,7 +708,81 @@ class NumaConfig {
 
     CpuIndex num_cpus() const { return nodeByCpu.size(); }
 
-    bool requires_memory_replication() const { return customAffinity || nodes.size() > 1; }
+    bool requires_memory_replication() const { return customAffinity || num_replicas() > 1; }
+
+    // Replicated memory is shared by the nodes split from the same NUMA node
+    NumaIndex num_replicas() const {
+        return replicaByNode.empty() ? nodes.size()
+                                     : *std::max_element(replicaByNode.begin(), replicaByNode.end())
+                                         + 1;
+    }
+
+    NumaIndex replica_of(NumaIndex n) const {
+        return replicaByNode.empty() ? n : replicaByNode[n];
+    }
+
+    // Nodes split by processor topology are domains of the NUMA node they come from
+    bool is_split() const { return !systemNodeByNode.empty(); }
+
+    NumaIndex system_node_of(NumaIndex n) const {
+        return systemNodeByNode.empty() ? n : systemNodeByNode[n];
+    }
+
+    NumaIndex first_node_of_replica(NumaIndex r) const {
+        NumaIndex n = 0;
+        while (replica_of(n) != r)
+            ++n;
+        return n;
+    }
+
+    // Splits each node by L3 cache domain, or by processor capacity with the
+    // fastest processors of all the nodes first. Threads are then bound to the
+    // split nodes, filling them in order, so that they share their L3 cache or
+    // run on the fast cores. Replicated memory stays per NUMA node, unless it is
+    // asked per split node, so that each L3 domain caches its own copy.
+    NumaConfig split_by_topology(const CpuTopology& topology,
+                                 bool               byL3,
+                                 bool               replicatePerSplitNode = false) const {
+        // Sort key of each split node: (-capacity, node) or (node, L3 domain)
+        std::map<std::pair<size_t, size_t>, std::set<CpuIndex>> splitNodes;
+
+        for (NumaIndex n = 0; n < nodes.size(); ++n)
+            for (CpuIndex c : nodes[n])
+            {
+                const auto l3       = topology.l3ByCpu.find(c);
+                const auto capacity = topology.capacityByCpu.find(c);
+
+                if (byL3)
+                    splitNodes[{n, l3 != topology.l3ByCpu.end() ? l3->second : CpuIndex(-1)}]
+                      .insert(c);
+                else
+                    splitNodes[{capacity != topology.capacityByCpu.end() ? ~capacity->second
+                                                                          : size_t(-1),
+                                n}]
+                      .insert(c);
+            }
+
+        NumaConfig cfg = empty();
+
+        for (auto&& [key, cpus] : splitNodes)
+        {
+            const NumaIndex splitNode = cfg.nodes.size();
+            const NumaIndex node      = byL3 ? key.first : key.second;
+
+            for (CpuIndex c : cpus)
+                cfg.add_cpu_to_node(splitNode, c);
+
+            cfg.systemNodeByNode.push_back(system_node_of(node));
+
+            if (!replicatePerSplitNode)
+                cfg.replicaByNode.push_back(replica_of(node));
+        }
+
+        cfg.customAffinity   = customAffinity;
+        cfg.fillNodesInOrder = true;
+
+        return cfg;
+    }
 
     std::string to_string() const {
         std::string str;
@@ -770,7 +880,17 @@ class NumaConfig {
         else
         {
             std::vector<size_t> occupation(nodes.size(), 0);
-            for (CpuIndex c = 0; c < numThreads; ++c)
+
+            // Nodes split by topology are filled one after the other, the threads
+            // beyond the number of processors are spread as usual.
+            if (fillNodesInOrder)
+                for (NumaIndex n = 0; n < nodes.size() && ns.size() < numThreads; ++n)
+                {
+                    occupation[n] = std::min(nodes[n].size(), numThreads - ns.size());
+                    ns.resize(ns.size() + occupation[n], n);
+                }
+
+            for (CpuIndex c = ns.size(); c < numThreads; ++c)
             {
                 NumaIndex bestNode{0};
                 float     bestNodeFill = std::numeric_limits<float>::max();
@@ -916,7 +1036,7 @@ class NumaConfig {
 
 #endif
 
-        return NumaReplicatedAccessToken(n);
+        return NumaReplicatedAccessToken(n, replica_of(n));
     }
 
     template<typename FuncT>
@@ -930,11 +1050,16 @@ class NumaConfig {
     }
 
    private:
+    friend struct CpuTopology;
+
     std::vector<std::set<CpuIndex>> nodes;
     std::map<CpuIndex, NumaIndex>   nodeByCpu;
+    std::vector<NumaIndex>          replicaByNode;     // Empty when each node has its replica
+    std::vector<NumaIndex>          systemNodeByNode;  // Empty when the nodes are not split
     CpuIndex                        highestCpuIndex;
 
     bool customAffinity;
+    bool fillNodesInOrder;
 
     static NumaConfig empty() { return NumaConfig(EmptyNodeTag{}); }
 
@@ -942,7 +1067,8 @@ class NumaConfig {
 
     NumaConfig(EmptyNodeTag) :
         highestCpuIndex(0),
-        customAffinity(false) {}
+        customAffinity(false),
+        fillNodesInOrder(false) {}
 
     void remove_empty_numa_nodes() {
         std::vector<std::set<CpuIndex>> newNodes;
@@ -1026,6 +1152,77 @@ class NumaConfig {
     }
 };
 
+// On Linux the L3 domain of a processor is listed by the cache of level 3, the
+// capacity is cpu_capacity when the kernel provides it. Intel hybrid CPUs list
+// their performance and efficiency cores apart, in cpu_core and cpu_atom.
+inline CpuTopology CpuTopology::from_sysfs([[maybe_unused]] const std::string& root) {
+    CpuTopology topology;
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+    auto read_list = [](const std::string& path) {
+        auto str = read_file_to_string(path);
+        if (!str.has_value())
+            return std::vector<size_t>{};
+
+        remove_whitespace(*str);
+        return NumaConfig::indices_from_shortened_string(*str);
+    };
+
+    auto read_number = [](const std::string& path) -> std::optional<size_t> {
+        auto str = read_file_to_string(path);
+        if (!str.has_value())
+            return std::nullopt;
+
+        remove_whitespace(*str);
+        if (str->empty() || !std::all_of(str->begin(), str->end(), ::isdigit))
+            return std::nullopt;
+
+        return str_to_size_t(*str);
+    };
+
+    for (CpuIndex c : read_list(root + "/system/cpu/online"))
+    {
+        const std::string cpu = root + "/system/cpu/cpu" + std::to_string(c);
+
+        for (int i = 0;; ++i)
+        {
+            const std::string cache = cpu + "/cache/index" + std::to_string(i);
+            const auto        level = read_number(cache + "/level");
+
+            if (!level.has_value())
+                break;
+
+            const auto shared = read_list(cache + "/shared_cpu_list");
+
+            if (*level == 3 && !shared.empty())
+            {
+                topology.l3ByCpu[c] = *std::min_element(shared.begin(), shared.end());
+                break;
+            }
+        }
+
+        if (const auto capacity = read_number(cpu + "/cpu_capacity"); capacity.has_value())
+            topology.capacityByCpu[c] = *capacity;
+    }
+
+    const auto performanceCores = read_list(root + "/cpu_core/cpus");
+    const auto efficiencyCores  = read_list(root + "/cpu_atom/cpus");
+
+    if (!performanceCores.empty() && !efficiencyCores.empty())
+    {
+        for (CpuIndex c : performanceCores)
+            topology.capacityByCpu[c] = 2;
+
+        for (CpuIndex c : efficiencyCores)
+            topology.capacityByCpu[c] = 1;
+    }
+
+#endif
+
+    return topology;
+}
+
 class NumaReplicationContext;
 
 // Instances of this class are tracked by the NumaReplicationContext instance.
@@ -1089,14 +1286,16 @@ class NumaReplicated: public NumaReplicatedBase {
     ~NumaReplicated() override = default;
 
     const T& operator[](NumaReplicatedAccessToken token) const {
-        assert(token.get_numa_index() < instances.size());
-        return *(instances[token.get_numa_index()]);
+        assert(token.get_replica_index() < instances.size());
+        return *(instances[token.get_replica_index()]);
     }
 
     const T& operator*() const { return *(instances[0]); }
 
     const T* operator->() const { return instances[0].get(); }
 
+    std::size_t num_replicas() const { return instances.size(); }
+
     template<typename FuncT>
     void modify_and_replicate(FuncT&& f) {
         auto source = std::move(instances[0]);
@@ -1120,15 +1319,16 @@ class NumaReplicated: public NumaReplicatedBase {
         const NumaConfig& cfg = get_numa_config();
         if (cfg.requires_memory_replication())
         {
-            for (NumaIndex n = 0; n < cfg.num_numa_nodes(); ++n)
+            for (NumaIndex r = 0; r < cfg.num_replicas(); ++r)
             {
-                cfg.execute_on_numa_node(
-                  n, [this, &source]() { instances.emplace_back(std::make_unique<T>(source)); });
+                cfg.execute_on_numa_node(cfg.first_node_of_replica(r), [this, &source]() {
+                    instances.emplace_back(std::make_unique<T>(source));
+                });
             }
         }
         else
         {
-            assert(cfg.num_numa_nodes() == 1);
+            assert(cfg.num_replicas() == 1);
             // We take advantage of the fact that replication is not required
             // and reuse the source value, avoiding one copy operation.
             instances.emplace_back(std::make_unique<T>(std::move(source)));
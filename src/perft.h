@@ -19,49 +19,284 @@
 #ifndef PERFT_H_INCLUDED
 #define PERFT_H_INCLUDED
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "memory.h"
+#include "misc.h"
 #include "movegen.h"
 #include "position.h"
+#include "thread.h"
 #include "types.h"
 #include "uci.h"
 
 namespace Hypnos::Benchmark {
 
+// PerftTable caches the node counts of already visited subtrees. It is shared
+// by all the perft threads without any locking: each entry stores the key xored
+// with the data, so that an entry torn by a concurrent write no longer matches
+// its key and is simply treated as a miss. The depth is packed in the low 8 bits
+// of the data, so that a hit is always exact. The table is allocated next to the
+// transposition table, hence its size is capped.
+class PerftTable {
+   public:
+    static constexpr size_t MaxMbSize = 256;
+
+    explicit PerftTable(size_t mbSize) :
+        entryCount(std::min(mbSize, MaxMbSize) * 1024 * 1024 / sizeof(Entry)),
+        table(make_unique_large_page<Entry[]>(entryCount)) {}
+
+    bool probe(Key key, Depth depth, uint64_t& nodes) const {
+        const Entry&   e    = table[mul_hi64(key, entryCount)];
+        const uint64_t data = e.data.load(std::memory_order_relaxed);
+
+        if ((e.check.load(std::memory_order_relaxed) ^ data) != key || Depth(data & 0xFF) != depth)
+            return false;
+
+        nodes = data >> 8;
+        return true;
+    }
+
+    void store(Key key, Depth depth, uint64_t nodes) {
+        Entry&         e    = table[mul_hi64(key, entryCount)];
+        const uint64_t data = nodes << 8 | uint64_t(depth);
+
+        e.check.store(key ^ data, std::memory_order_relaxed);
+        e.data.store(data, std::memory_order_relaxed);
+    }
+
+   private:
+    struct Entry {
+        std::atomic<uint64_t> check, data;
+    };
+
+    size_t                entryCount;
+    LargePagePtr<Entry[]> table;
+};
+
 // Utility to verify move generation. All the leaf nodes up
 // to the given depth are generated and counted, and the sum is returned.
-template<bool Root>
-uint64_t perft(Position& pos, Depth depth) {
+inline uint64_t perft(Position& pos, Depth depth, PerftTable* tt) {
 
     StateInfo st;
     ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
-    uint64_t   cnt, nodes = 0;
-    const bool leaf = (depth == 2);
+    uint64_t   nodes = 0;
+    const bool leaf  = (depth == 2);
+
+    if (tt && tt->probe(pos.key(), depth, nodes))
+        return nodes;
 
     for (const auto& m : MoveList<LEGAL>(pos))
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
-        else
-        {
-            pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
-            pos.undo_move(m);
-        }
-        if (Root)
-            sync_cout << UCIEngine::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
+        pos.do_move(m, st);
+        nodes += leaf ? move_count<LEGAL>(pos) : perft(pos, depth - 1, tt);
+        pos.undo_move(m);
     }
+
+    if (tt)
+        tt->store(pos.key(), depth, nodes);
+
     return nodes;
 }
 
-inline uint64_t perft(const std::string& fen, Depth depth, bool isChess960) {
+// Splits the root moves among the threads of the pool. Each thread picks the
+// next unprocessed root move and counts its subtree on its own copy of the root
+// position, so the result does not depend on the number of threads. The counts
+// per root move are printed in move generation order once all threads are done.
+inline uint64_t perft(const std::string& fen,
+                      Depth              depth,
+                      bool               isChess960,
+                      ThreadPool&        threads,
+                      size_t             ttSizeMb) {
+
     StateListPtr states(new std::deque<StateInfo>(1));
     Position     p;
     p.set(fen, isChess960, &states->back());
 
-    return perft<true>(p, depth);
+    const MoveList<LEGAL> rootMoves(p);
+    std::vector<uint64_t> counts(rootMoves.size(), 1);
+    std::atomic<size_t>   nextMove(0);
+
+    // Only subtrees of depth 2 or more are cached, hence the table is useless
+    // below a root depth of 3.
+    std::unique_ptr<PerftTable> tt =
+      ttSizeMb && depth > 2 ? std::make_unique<PerftTable>(ttSizeMb) : nullptr;
+
+    if (depth > 1)
+    {
+        for (size_t i = 0; i < threads.num_threads(); ++i)
+            threads.run_on_thread(i, [&]() {
+                StateListPtr threadStates(new std::deque<StateInfo>(2));
+                Position     pos;
+                pos.set(fen, isChess960, &threadStates->front());
+
+                for (size_t idx; (idx = nextMove.fetch_add(1)) < rootMoves.size();)
+                {
+                    const Move m = *(rootMoves.begin() + idx);
+
+                    pos.do_move(m, threadStates->back());
+                    counts[idx] = depth == 2 ? move_count<LEGAL>(pos)
+                                             : perft(pos, depth - 1, tt.get());
+                    pos.undo_move(m);
+                }
+            });
+
+        for (size_t i = 0; i < threads.num_threads(); ++i)
+            threads.wait_on_thread(i);
+    }
+
+    uint64_t nodes = 0;
+
+    for (size_t idx = 0; idx < rootMoves.size(); ++idx)
+    {
+        const Move m = *(rootMoves.begin() + idx);
+
+        sync_cout << UCIEngine::move(m, p.is_chess960()) << ": " << counts[idx] << sync_endl;
+        nodes += counts[idx];
+    }
+
+    return nodes;
+}
+
+// Returns the white back rank, from the a-file to the h-file, of the Chess960
+// starting position with the given number in Scharnagl's numbering scheme.
+// Number 518 is the standard starting position.
+inline std::string chess960_back_rank(int idx) {
+
+    constexpr int Knights[10][2] = {{0, 1}, {0, 2}, {0, 3}, {0, 4}, {1, 2},
+                                    {1, 3}, {1, 4}, {2, 3}, {2, 4}, {3, 4}};
+    std::string   rank(8, ' ');
+
+    // Puts the piece on the nth still empty square of the rank
+    auto place = [&](char piece, int nth) {
+        for (char& c : rank)
+            if (c == ' ' && !nth--)
+            {
+                c = piece;
+                return;
+            }
+    };
+
+    rank[2 * (idx % 4) + 1] = 'B', idx /= 4;
+    rank[2 * (idx % 4)]     = 'B', idx /= 4;
+    place('Q', idx % 6), idx /= 6;
+    place('N', Knights[idx][1]);
+    place('N', Knights[idx][0]);
+    place('R', 0);
+    place('K', 0);
+    place('R', 0);
+
+    return rank;
+}
+
+// Returns the FEN of the Double Fischer Random starting position with the given
+// white and black back ranks, castling rights in Shredder notation.
+inline std::string dfrc_fen(int whiteIdx, int blackIdx) {
+
+    std::string white = chess960_back_rank(whiteIdx);
+    std::string black = chess960_back_rank(blackIdx);
+    std::string castling;
+
+    for (int f = FILE_H; f >= FILE_A; --f)
+        if (white[f] == 'R')
+            castling += char('A' + f);
+
+    for (int f = FILE_H; f >= FILE_A; --f)
+        if (black[f] == 'R')
+            castling += char('a' + f);
+
+    std::transform(black.begin(), black.end(), black.begin(),
+                   [](char c) { return char(std::tolower(c)); });
+
+    return black + "/pppppppp/8/8/8/8/PPPPPPPP/" + white + " w " + castling + " - 0 1";
+}
+
+// Counts the perft nodes of all the given starting positions together. Each
+// thread picks the next unprocessed position and counts it on its own Position,
+// the transposition table being shared by all of them.
+template<typename FenFn>
+uint64_t perft_family(size_t count, FenFn fen, Depth depth, ThreadPool& threads, PerftTable* tt) {
+
+    std::atomic<size_t>   nextPos(0);
+    std::atomic<uint64_t> nodes(0);
+
+    for (size_t i = 0; i < threads.num_threads(); ++i)
+        threads.run_on_thread(i, [&]() {
+            StateInfo st;
+            Position  pos;
+            uint64_t  n = 0;
+
+            for (size_t idx; (idx = nextPos.fetch_add(1)) < count;)
+            {
+                pos.set(fen(idx), true, &st);
+                n += depth == 1 ? move_count<LEGAL>(pos) : perft(pos, depth, tt);
+            }
+
+            nodes += n;
+        });
+
+    for (size_t i = 0; i < threads.num_threads(); ++i)
+        threads.wait_on_thread(i);
+
+    return nodes;
+}
+
+// Total perft node counts of the 960 Chess960 starting positions and of the
+// 960 x 960 Double Fischer Random ones, indexed by depth.
+constexpr uint64_t Chess960Nodes[] = {0, 18882, 371766, 8224968, 181106056, 4433048830};
+constexpr uint64_t DfrcNodes[]     = {0, 18126720, 356529924, 7882385400};
+
+// Regression suite for the Chess960 move generation: runs perft on every
+// Chess960 and Double Fischer Random starting position, compares the totals
+// with the known ones and reports the throughput of each family. A family is
+// skipped at depth 0. Returns false if any of the counts is wrong.
+inline bool perft960(Depth chess960Depth, Depth dfrcDepth, ThreadPool& threads, size_t ttSizeMb) {
+
+    std::unique_ptr<PerftTable> tt = ttSizeMb && std::max(chess960Depth, dfrcDepth) > 2
+                                     ? std::make_unique<PerftTable>(ttSizeMb)
+                                     : nullptr;
+    bool                        ok = true;
+
+    auto run = [&](const char* name, size_t count, auto fen, Depth depth,
+                   const uint64_t* expected, size_t maxDepth) {
+        if (depth <= 0)
+            return;
+
+        TimePoint      elapsed = now();
+        const uint64_t nodes   = perft_family(count, fen, depth, threads, tt.get());
+        elapsed                = now() - elapsed + 1;
+
+        sync_cout << name << ": " << count << " positions, depth " << depth << ", nodes "
+                  << nodes << ", time " << elapsed << " ms, nps " << 1000 * nodes / elapsed;
+
+        if (size_t(depth) > maxDepth)
+            std::cout << ", no reference count";
+        else if (nodes == expected[depth])
+            std::cout << ", OK";
+        else
+        {
+            std::cout << ", FAILED (expected " << expected[depth] << ")";
+            ok = false;
+        }
+
+        std::cout << sync_endl;
+    };
+
+    run("Chess960", 960, [](size_t idx) { return dfrc_fen(int(idx), int(idx)); }, chess960Depth,
+        Chess960Nodes, std::size(Chess960Nodes) - 1);
+    run("DFRC", 960 * 960, [](size_t idx) { return dfrc_fen(int(idx / 960), int(idx % 960)); },
+        dfrcDepth, DfrcNodes, std::size(DfrcNodes) - 1);
+
+    return ok;
 }
 }
 
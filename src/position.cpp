@@ -1120,6 +1120,10 @@ void Position::set_state() const {
 
     set_check_info();
 
+#ifdef USE_ATTACK_MAPS
+    update_attack_maps(~0u);
+#endif
+
     for (Bitboard b = pieces(); b;)
     {
         Square s  = pop_lsb(b);
@@ -1147,6 +1151,85 @@ void Position::set_state() const {
 }
 
 
+#ifdef USE_ATTACK_MAPS
+// Returns the attack maps changed by the last move, one bit for each color and
+// piece type: the ones of the pieces which have moved, appeared or disappeared,
+// and the ones of the sliders which see a square whose occupancy has changed.
+// The attacks of any other slider are blocked before such squares, or do not
+// reach them at all, so they are the same as in the previous position.
+unsigned Position::dirty_attack_maps() const {
+
+    const DirtyPiece& dp      = st->dirtyPiece;
+    Bitboard          changed = 0, bishopRays = 0, rookRays = 0;
+    unsigned          dirty   = 0;
+
+    for (int i = 0; i < dp.dirty_num; ++i)
+    {
+        dirty |= 1 << (color_of(dp.piece[i]) * PIECE_TYPE_NB + type_of(dp.piece[i]));
+
+        if (dp.from[i] != SQ_NONE)
+            changed |= dp.from[i];
+
+        if (dp.to[i] != SQ_NONE)
+            changed |= dp.to[i];
+    }
+
+    while (changed)
+    {
+        Square s = pop_lsb(changed);
+        bishopRays |= attacks_bb<BISHOP>(s, pieces());
+        rookRays |= attacks_bb<ROOK>(s, pieces());
+    }
+
+    for (Color c : {WHITE, BLACK})
+    {
+        if (pieces(c, BISHOP) & bishopRays)
+            dirty |= 1 << (c * PIECE_TYPE_NB + BISHOP);
+
+        if (pieces(c, ROOK) & rookRays)
+            dirty |= 1 << (c * PIECE_TYPE_NB + ROOK);
+
+        if (pieces(c, QUEEN) & (bishopRays | rookRays))
+            dirty |= 1 << (c * PIECE_TYPE_NB + QUEEN);
+    }
+
+    return dirty;
+}
+
+
+// Recomputes the attack maps selected by 'dirty', as returned by
+// dirty_attack_maps(), and copies the other ones from the previous state.
+void Position::update_attack_maps(unsigned dirty) const {
+
+    for (Color c : {WHITE, BLACK})
+    {
+        Bitboard* attackedBy = st->attackedBy[c];
+
+        attackedBy[ALL_PIECES] = 0;
+
+        for (PieceType pt = PAWN; pt <= KING; ++pt)
+        {
+            if (!(dirty & (1 << (c * PIECE_TYPE_NB + pt))))
+                attackedBy[pt] = st->previous->attackedBy[c][pt];
+
+            else if (pt == PAWN)
+                attackedBy[pt] = c == WHITE ? pawn_attacks_bb<WHITE>(pieces(WHITE, PAWN))
+                                            : pawn_attacks_bb<BLACK>(pieces(BLACK, PAWN));
+            else
+            {
+                attackedBy[pt] = 0;
+
+                for (Bitboard b = pieces(c, pt); b;)
+                    attackedBy[pt] |= attacks_bb(pt, pop_lsb(b), pieces());
+            }
+
+            attackedBy[ALL_PIECES] |= attackedBy[pt];
+        }
+    }
+}
+#endif
+
+
 // Overload to initialize the position object with the given endgame code string
 // like "KBPKN". It's mainly a helper to get the material key out of an endgame code.
 Position& Position::set(const string& code, Color c, StateInfo* si) {
@@ -1216,6 +1299,85 @@ string Position::fen() const {
     return ss.str();
 }
 
+// Returns the compact binary encoding of the position. Unlike fen(), it keeps
+// the exact castling rook squares and needs no string formatting. The position
+// must be packable(), callers fall back to fen() otherwise.
+PackedPosition Position::encode() const {
+
+    assert(packable());
+
+    PackedPosition pp{};
+    int            idx = 0;
+
+    pp.occupied = pieces();
+
+    for (Bitboard b = pieces(); b; ++idx)
+    {
+        Square  s    = pop_lsb(b);
+        uint8_t code = piece_on(s);
+
+        if (type_of(piece_on(s)) == ROOK && (castlingRightsMask[s] & st->castlingRights))
+            code = make_piece(color_of(piece_on(s)), KING) + 1;
+
+        pp.pieces[idx / 2] |= code << (4 * (idx & 1));
+    }
+
+    pp.gamePly  = uint16_t(gamePly);
+    pp.rule50   = uint8_t(std::min(st->rule50, 255));
+    pp.epSquare = uint8_t(st->epSquare);
+    pp.flags    = uint8_t(sideToMove) | uint8_t(chess960) << 1;
+
+    return pp;
+}
+
+
+// Initializes the position from its compact binary encoding. This is the
+// counterpart of encode() and is much faster than parsing a FEN string.
+Position& Position::decode(const PackedPosition& pp, StateInfo* si) {
+
+    Bitboard castlingRooks = 0;
+    int      idx           = 0;
+
+    std::memset(this, 0, sizeof(Position));
+    std::memset(si, 0, sizeof(StateInfo));
+    st = si;
+
+    for (Bitboard b = pp.occupied; b; ++idx)
+    {
+        Square  s    = pop_lsb(b);
+        uint8_t code = (pp.pieces[idx / 2] >> (4 * (idx & 1))) & 0xF;
+
+        // Castling rooks are coded right after the king of the same color
+        if ((code & 7) == KING + 1)
+        {
+            castlingRooks |= s;
+            code = make_piece(Color(code >> 3), ROOK);
+        }
+
+        put_piece(Piece(code), s);
+    }
+
+    // The kings must be on the board before setting the castling rights
+    while (castlingRooks)
+    {
+        Square s = pop_lsb(castlingRooks);
+        set_castling_right(color_of(piece_on(s)), s);
+    }
+
+    sideToMove   = Color(pp.flags & 1);
+    chess960     = pp.flags & 2;
+    gamePly      = pp.gamePly;
+    st->rule50   = pp.rule50;
+    st->epSquare = Square(pp.epSquare);
+
+    set_state();
+
+    assert(pos_is_ok());
+
+    return *this;
+}
+
+
 // Calculates st->blockersForKing[c] and st->pinners[~c],
 // which store respectively the pieces preventing king of color c from being in check
 // and the slider pieces of color ~c pinning pieces of color c to the king.
@@ -1329,11 +1491,10 @@ bool Position::pseudo_legal(const Move m) const {
     Square to   = m.to_sq();
     Piece  pc   = moved_piece(m);
 
-    // Use a slower but simpler function for uncommon cases
-    // yet we skip the legality check of MoveList<LEGAL>().
+    // Use a slower but simpler function for uncommon cases. As the move
+    // generator emits only legal moves, illegal ones are rejected as well.
     if (m.type_of() != NORMAL)
-        return checkers() ? MoveList<EVASIONS>(*this).contains(m)
-                          : MoveList<NON_EVASIONS>(*this).contains(m);
+        return MoveList<LEGAL>(*this).contains(m);
 
     // Is not a promotion, so the promotion piece must be empty
     assert(m.promotion_type() - KNIGHT == NO_PIECE_TYPE);
@@ -1609,6 +1770,10 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
     // Calculate checkers bitboard (if move gives check)
     st->checkersBB = givesCheck ? attackers_to(square<KING>(them)) & pieces(us) : 0;
 
+#ifdef USE_ATTACK_MAPS
+    update_attack_maps(dirty_attack_maps());
+#endif
+
     sideToMove = ~sideToMove;
 
     // Update king attacks used for fast check detection
@@ -1781,21 +1946,49 @@ void Position::undo_null_move() {
 }
 
 
-// Computes the new hash key after the given move. Needed
-// for speculative prefetch. It doesn't recognize special moves like castling,
-// en passant and promotions.
+// Computes the new hash key after the given move. Needed for speculative
+// prefetch, so it follows do_move() exactly: special moves, castling rights
+// and en passant squares all change the key, and a wrong key would prefetch
+// the wrong cluster.
 Key Position::key_after(Move m) const {
 
     Square from     = m.from_sq();
     Square to       = m.to_sq();
     Piece  pc       = piece_on(from);
     Piece  captured = piece_on(to);
+    Color  us       = color_of(pc);
     Key    k        = st->key ^ Zobrist::side;
 
+    if (m.type_of() == CASTLING)
+    {
+        // Castling is encoded as "king captures friendly rook"
+        bool kingSide = to > from;
+        k ^= Zobrist::psq[captured][to]
+           ^ Zobrist::psq[captured][relative_square(us, kingSide ? SQ_F1 : SQ_D1)];
+        to       = relative_square(us, kingSide ? SQ_G1 : SQ_C1);
+        captured = NO_PIECE;
+    }
+
+    else if (m.type_of() == EN_PASSANT)
+        k ^= Zobrist::psq[make_piece(~us, PAWN)][to - pawn_push(us)];
+
     if (captured)
         k ^= Zobrist::psq[captured][to];
 
-    k ^= Zobrist::psq[pc][to] ^ Zobrist::psq[pc][from];
+    k ^= Zobrist::psq[pc][from]
+       ^ Zobrist::psq[m.type_of() == PROMOTION ? make_piece(us, m.promotion_type()) : pc][to];
+
+    if (st->epSquare != SQ_NONE)
+        k ^= Zobrist::enpassant[file_of(st->epSquare)];
+
+    if (st->castlingRights && (castlingRightsMask[from] | castlingRightsMask[to]))
+        k ^= Zobrist::castling[st->castlingRights]
+           ^ Zobrist::castling[st->castlingRights
+                               & ~(castlingRightsMask[from] | castlingRightsMask[to])];
+
+    if (type_of(pc) == PAWN && (int(to) ^ int(from)) == 16
+        && (pawn_attacks_bb(us, to - pawn_push(us)) & pieces(~us, PAWN)))
+        k ^= Zobrist::enpassant[file_of(to)];
 
     return (captured || type_of(pc) == PAWN) ? k : adjust_key50<true>(k);
 }
@@ -1822,6 +2015,13 @@ bool Position::see_ge(Move m, int threshold) const {
     if (swap <= 0)
         return true;
 
+    // Without any attack on 'from' or 'to', the opponent cannot recapture, not
+    // even with an x-ray attack through 'from'.
+#ifdef USE_ATTACK_MAPS
+    if (!(st->attackedBy[~sideToMove][ALL_PIECES] & (from | to)))
+        return true;
+#endif
+
     assert(color_of(piece_on(from)) == sideToMove);
     Bitboard occupied  = pieces() ^ from ^ to;  // xoring to is important for pinned piece logic
     Color    stm       = sideToMove;
@@ -1909,7 +2109,7 @@ bool Position::see_ge(Move m, int threshold) const {
 // or by repetition. It does not detect stalemates.
 bool Position::is_draw(int ply) const {
 
-    if (st->rule50 > 99 && (!checkers() || MoveList<LEGAL>(*this).size()))
+    if (st->rule50 > 99 && (!checkers() || move_count<LEGAL>(*this)))
         return true;
 
     // Return a draw score if a position repeats once earlier but strictly
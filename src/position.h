@@ -62,6 +62,11 @@ struct StateInfo {
     Piece      capturedPiece;
     int        repetition;
 
+#ifdef USE_ATTACK_MAPS
+    // Squares attacked by each color and piece type, ALL_PIECES for all of them
+    Bitboard attackedBy[COLOR_NB][PIECE_TYPE_NB];
+#endif
+
     // Used by NNUE
     Eval::NNUE::Accumulator<Eval::NNUE::TransformedFeatureDimensionsBig>   accumulatorBig;
     Eval::NNUE::Accumulator<Eval::NNUE::TransformedFeatureDimensionsSmall> accumulatorSmall;
@@ -69,6 +74,27 @@ struct StateInfo {
 };
 
 
+// PackedPosition is a fixed size binary encoding of a position, used instead of
+// a FEN string when positions are copied in bulk or stored as records. The
+// occupied squares are stored as a bitboard followed by one 4-bit piece code per
+// occupied square, in square order. Rooks with castling rights use the spare
+// codes after the king, so that Chess960 castling rights are encoded exactly.
+// Only positions with at most MaxPieces pieces can be encoded, see packable().
+struct PackedPosition {
+    static constexpr int MaxPieces = 32;
+
+    Bitboard occupied;
+    uint8_t  pieces[16];
+    uint16_t gamePly;
+    uint8_t  rule50;
+    uint8_t  epSquare;
+    uint8_t  flags;  // Side to move in bit 0, Chess960 in bit 1
+    uint8_t  padding[3];
+};
+
+static_assert(sizeof(PackedPosition) == 32, "Unexpected PackedPosition size");
+
+
 // A list to keep track of the position states along the setup moves (from the
 // start position to the position just before the search starts). Needed by
 // 'draw by repetition' detection. Use a std::deque because pointers to
@@ -93,6 +119,11 @@ class Position {
     Position&   set(const std::string& code, Color c, StateInfo* si);
     std::string fen() const;
 
+    // Compact binary input/output
+    Position&      decode(const PackedPosition& pp, StateInfo* si);
+    PackedPosition encode() const;
+    bool           packable() const;
+
     // Position representation
     Bitboard pieces(PieceType pt = ALL_PIECES) const;
     template<typename... PieceTypes>
@@ -177,9 +208,13 @@ class Position {
 
    private:
     // Initialization helpers (used while setting up a position)
-    void set_castling_right(Color c, Square rfrom);
-    void set_state() const;
-    void set_check_info() const;
+    void     set_castling_right(Color c, Square rfrom);
+    void     set_state() const;
+    void     set_check_info() const;
+#ifdef USE_ATTACK_MAPS
+    unsigned dirty_attack_maps() const;
+    void     update_attack_maps(unsigned dirty) const;
+#endif
 
     // Other helpers
     void move_piece(Square from, Square to);
@@ -268,6 +303,9 @@ inline Bitboard Position::attackers_to(Square s) const { return attackers_to(s,
 template<PieceType Pt>
 inline Bitboard Position::attacks_by(Color c) const {
 
+#ifdef USE_ATTACK_MAPS
+    return st->attackedBy[c][Pt];
+#else
     if constexpr (Pt == PAWN)
         return c == WHITE ? pawn_attacks_bb<WHITE>(pieces(WHITE, PAWN))
                           : pawn_attacks_bb<BLACK>(pieces(BLACK, PAWN));
@@ -279,6 +317,7 @@ inline Bitboard Position::attacks_by(Color c) const {
             threats |= attacks_bb<Pt>(pop_lsb(attackers), pieces());
         return threats;
     }
+#endif
 }
 
 inline Bitboard Position::checkers() const { return st->checkersBB; }
@@ -312,6 +351,11 @@ inline int Position::rule50_count() const { return st->rule50; }
 
 inline bool Position::is_chess960() const { return chess960; }
 
+// A legal game has at most 32 pieces, but set() accepts FENs with more
+inline bool Position::packable() const {
+    return popcount(pieces()) <= PackedPosition::MaxPieces;
+}
+
 inline bool Position::capture(Move m) const {
     assert(m.is_ok());
     return (!empty(m.to_sq()) && m.type_of() != CASTLING) || m.type_of() == EN_PASSANT;
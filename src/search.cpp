@@ -179,6 +179,8 @@ void Search::Worker::start_searching() {
         return;
     }
 
+    const TB::ProbeStats tbStats = TB::probe_stats();
+
     main_manager()->tm.init(limits, rootPos.side_to_move(), rootPos.game_ply(), options,
                             main_manager()->originalTimeAdjust);
     tt.new_search();
@@ -286,6 +288,11 @@ void Search::Worker::start_searching() {
     if (bestThread != this)
         main_manager()->pv(*bestThread, threads, tt, bestThread->completedDepth);
 
+    // Report the tablebase probes that had to wait for the disk during this search
+    if (TB::ProbeStats stats = TB::probe_stats(); stats.stalls > tbStats.stalls)
+        sync_cout << "info string Syzygy probe stalls " << stats.stalls - tbStats.stalls << ", "
+                  << (stats.stallTime - tbStats.stallTime) / 1000 << " ms" << sync_endl;
+
     std::string ponder;
 
     if (bestThread->rootMoves[0].pv.size() > 1
@@ -617,12 +624,16 @@ void Search::Worker::clear() {
                 for (auto& h : to)
                     h->fill(-658);
 
-    for (size_t i = 1; i < reductions.size(); ++i)
-        reductions[i] = int((18.62 + std::log(size_t(options["Threads"])) / 2) * std::log(i));
+    init_reductions();
 
     refreshTable.clear(networks[numaAccessToken]);
 }
 
+void Search::Worker::init_reductions() {
+    for (size_t i = 1; i < reductions.size(); ++i)
+        reductions[i] = int((18.62 + std::log(size_t(options["Threads"])) / 2) * std::log(i));
+}
+
 
 // Main search function for both PV and non-PV nodes
 template<NodeType nodeType>
@@ -1086,9 +1097,10 @@ Value Search::Worker::search(
             if (move == excludedMove)
                 continue;
 
-            if (!pos.legal(move))
+            if (!HasLegalStages && !pos.legal(move))
                 continue;
 
+            assert(pos.legal(move));
             assert(pos.capture_stage(move));
 
             movedPiece = pos.moved_piece(move);
@@ -1165,10 +1177,12 @@ moves_loop:  // When in check, search starts here
         if (move == excludedMove)
             continue;
 
-        // Check for legality
-        if (!pos.legal(move))
+        // Check for legality, not needed when MovePicker only emits legal moves
+        if (!HasLegalStages && !pos.legal(move))
             continue;
 
+        assert(pos.legal(move));
+
         // At root obey the "searchmoves" option and skip moves not listed in Root
         // Move List. In MultiPV mode we also skip PV moves that have been already
         // searched and those of lower "TB rank" if we are in a TB root position.
@@ -1575,7 +1589,7 @@ moves_loop:  // When in check, search starts here
     // must be a mate or a stalemate. If we are in a singular extension search then
     // return a fail low score.
 
-    assert(moveCount || !ss->inCheck || excludedMove || !MoveList<LEGAL>(pos).size());
+    assert(moveCount || !ss->inCheck || excludedMove || !move_count<LEGAL>(pos));
 
     // Adjust best value for fail high cases at non-pv nodes
     if (!PvNode && bestValue >= beta && std::abs(bestValue) < VALUE_TB_WIN_IN_MAX_PLY
@@ -1786,9 +1800,11 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     {
         assert(move.is_ok());
 
-        if (!pos.legal(move))
+        if (!HasLegalStages && !pos.legal(move))
             continue;
 
+        assert(pos.legal(move));
+
         givesCheck = pos.gives_check(move);
         capture    = pos.capture_stage(move);
 
@@ -1906,7 +1922,7 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     // in check and no legal moves were found, it is checkmate.
     if (ss->inCheck && bestValue == -VALUE_INFINITE)
     {
-        assert(!MoveList<LEGAL>(pos).size());
+        assert(!move_count<LEGAL>(pos));
         return mated_in(ss->ply);  // Plies to mate from the root
     }
 
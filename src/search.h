@@ -273,6 +273,10 @@ class Worker {
     // Reset histories, usually before a new game.
     void clear();
 
+    // Reductions depend on the number of threads, they are set again when the
+    // thread pool is resized and the worker is kept.
+    void init_reductions();
+
     // Called when the program receives the UCI 'go' command.
     // It searches from the root position and outputs the "bestmove".
     void start_searching();
@@ -21,30 +21,40 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <deque>
 #include <fstream>
 #include <initializer_list>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string_view>
 #include <sys/stat.h>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "../bitboard.h"
+#include "../memory.h"
 #include "../misc.h"
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../types.h"
 #include "../ucioption.h"
 
 #ifndef _WIN32
+    #include <dirent.h>
     #include <fcntl.h>
     #include <sys/mman.h>
     #include <unistd.h>
@@ -185,6 +195,29 @@ static_assert(sizeof(LR) == 3, "LR tree entry must be 3 bytes");
 //  TBTable:  one object for each file with corresponding indexing information
 //  TBTables: has ownership of TBTable objects, keeping a list and a hash
 
+// Counters of the "tb stats" command that are not tied to a table
+std::atomic<uint64_t> MapEvents, UnmapEvents;
+
+// Size of the table files currently mapped, not counting the pinned ones
+std::atomic<uint64_t> MappedBytes;
+
+// Contents of the pinned table files, by path. They are read in large page
+// memory once and kept across the reloads of a new game, until the file is
+// not pinned anymore or the directories are scanned again.
+struct PinnedFile {
+    std::unique_ptr<void, void (*)(void*)> data;  // Page aligned, as a mapping
+    uint64_t                               size;
+    bool                                   used;
+};
+
+std::unordered_map<std::string, PinnedFile> PinnedFiles;
+
+// Tables to pin, in TB file naming like "KRPvKR", and the memory budget in MB
+// for their decoded blocks. Set by the "SyzygyPinned" options.
+std::vector<std::string> PinnedCodes;
+size_t                   PinnedDecodeMb = 0;
+uint64_t                 PinnedCount = 0, PinnedBytes = 0;
+
 // class TBFile memory maps/unmaps the single .rtbw and .rtbz files. Files are
 // memory mapped for best performance. Files are mapped at first access: at init
 // time only existence of the file is checked.
@@ -201,17 +234,109 @@ class TBFile: public std::ifstream {
     // C:\tb\wdl345;C:\tb\wdl6;D:\tb\dtz345;D:\tb\dtz6
     static std::string Paths;
 
-    TBFile(const std::string& f) {
+    // Table files found in the Paths directories, keyed by file name. Where a
+    // name appears in more than one directory, the first directory wins.
+    static std::unordered_map<std::string, std::string> Files;
+    static std::string                                  ListedPaths;
+
+    static std::vector<std::string> directories() {
 
 #ifndef _WIN32
         constexpr char SepChar = ':';
 #else
         constexpr char SepChar = ';';
 #endif
-        std::stringstream ss(Paths);
-        std::string       path;
+        std::stringstream        ss(Paths);
+        std::string              path;
+        std::vector<std::string> dirs;
 
         while (std::getline(ss, path, SepChar))
+            if (!path.empty())
+                dirs.push_back(path);
+
+        return dirs;
+    }
+
+    // Lists the .rtbw and .rtbz files of a single directory
+    static std::vector<std::string> list(const std::string& dir) {
+
+        std::vector<std::string> names;
+
+        auto isTable = [](const std::string& name) {
+            return name.size() > 5
+                && (name.compare(name.size() - 5, 5, ".rtbw") == 0
+                    || name.compare(name.size() - 5, 5, ".rtbz") == 0);
+        };
+
+#ifndef _WIN32
+        if (DIR* d = opendir(dir.c_str()))
+        {
+            while (const dirent* e = readdir(d))
+                if (isTable(e->d_name))
+                    names.emplace_back(e->d_name);
+
+            closedir(d);
+        }
+#else
+        WIN32_FIND_DATAA data;
+        HANDLE           h = FindFirstFileA((dir + "\\*").c_str(), &data);
+
+        if (h != INVALID_HANDLE_VALUE)
+        {
+            do
+                if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && isTable(data.cFileName))
+                    names.emplace_back(data.cFileName);
+            while (FindNextFileA(h, &data));
+
+            FindClose(h);
+        }
+#endif
+        return names;
+    }
+
+    // Builds the file list, enumerating the directories in parallel, one thread
+    // each, as they often sit on different drives. The list is kept until Paths
+    // changes or a rescan is requested, so that a new game does not stat again
+    // every candidate file name.
+    static void scan(bool rescan) {
+
+        if (!rescan && ListedPaths == Paths)
+            return;
+
+        std::vector<std::string>              dirs = directories();
+        std::vector<std::vector<std::string>> found(dirs.size());
+        std::vector<std::thread>              threads;
+
+        for (size_t i = 0; i < dirs.size(); ++i)
+            threads.emplace_back([&, i]() { found[i] = list(dirs[i]); });
+
+        for (auto& th : threads)
+            th.join();
+
+        Files.clear();
+
+        for (size_t i = 0; i < dirs.size(); ++i)
+            for (const auto& name : found[i])
+                Files.emplace(name, dirs[i] + "/" + name);
+
+        ListedPaths = Paths;
+    }
+
+    static bool exists(const std::string& f) { return Files.count(f); }
+
+    TBFile(const std::string& f) {
+
+        // A file added after the scan is still looked for in the directories
+        auto it = Files.find(f);
+        if (it != Files.end())
+        {
+            fname = it->second;
+            std::ifstream::open(fname);
+            if (is_open())
+                return;
+        }
+
+        for (const auto& path : directories())
         {
             fname = path + "/" + f;
             std::ifstream::open(fname);
@@ -290,16 +415,72 @@ class TBFile: public std::ifstream {
 #endif
         uint8_t* data = (uint8_t*) *baseAddress;
 
+        if (!has_magic(data, type))
+        {
+            unmap(*baseAddress, *mapping);
+            return *baseAddress = nullptr, nullptr;
+        }
+
+        return data + 4;  // Skip Magics's header
+    }
+
+    // Read the whole file in large page memory instead of mapping it, for the
+    // pinned tables. The file is read only once, see PinnedFiles.
+    uint8_t* load(void** baseAddress, uint64_t* size, TBType type) {
+
+        auto it = PinnedFiles.find(fname);
+
+        if (it == PinnedFiles.end())
+        {
+            close();
+            std::ifstream::open(fname, std::ios::binary | std::ios::ate);
+
+            if (!is_open())
+                return *baseAddress = nullptr, nullptr;
+
+            const uint64_t fileSize = uint64_t(tellg());
+
+            if (fileSize % 64 != 16)
+            {
+                std::cerr << "Corrupt tablebase file " << fname << std::endl;
+                exit(EXIT_FAILURE);
+            }
+
+            std::unique_ptr<void, void (*)(void*)> buffer(aligned_large_pages_alloc(fileSize),
+                                                          aligned_large_pages_free);
+            seekg(0);
+
+            if (!buffer || !read((char*) buffer.get(), std::streamsize(fileSize)))
+            {
+                std::cerr << "Could not load " << fname << std::endl;
+                return *baseAddress = nullptr, nullptr;
+            }
+
+            it = PinnedFiles.emplace(fname, PinnedFile{std::move(buffer), fileSize, false}).first;
+        }
+
+        uint8_t* data   = (uint8_t*) it->second.data.get();
+        it->second.used = true;
+        *size           = it->second.size;
+        *baseAddress    = data;
+
+        if (!has_magic(data, type))
+            return *baseAddress = nullptr, nullptr;
+
+        return data + 4;  // Skip Magics's header
+    }
+
+    bool has_magic(const uint8_t* data, TBType type) const {
+
         constexpr uint8_t Magics[][4] = {{0xD7, 0x66, 0x0C, 0xA5}, {0x71, 0xE8, 0x23, 0x5D}};
 
         if (memcmp(data, Magics[type == WDL], 4))
         {
             std::cerr << "Corrupted table in file " << fname << std::endl;
-            unmap(*baseAddress, *mapping);
-            return *baseAddress = nullptr, nullptr;
+            return false;
         }
 
-        return data + 4;  // Skip Magics's header
+        return true;
     }
 
     static void unmap(void* baseAddress, uint64_t mapping) {
@@ -313,7 +494,9 @@ class TBFile: public std::ifstream {
     }
 };
 
-std::string TBFile::Paths;
+std::string                                  TBFile::Paths;
+std::string                                  TBFile::ListedPaths;
+std::unordered_map<std::string, std::string> TBFile::Files;
 
 // struct PairsData contains low-level indexing information to access TB data.
 // There are 8, 4, or 2 PairsData records for each TBTable, according to the type
@@ -336,12 +519,100 @@ struct PairsData {
       base64;  // base64[l - min_sym_len] is the 64bit-padded lowest symbol of length l
     std::vector<uint8_t>
              symlen;  // Number of values (-1) represented by a given Huffman symbol: 1..256
+    std::unique_ptr<std::atomic<uint16_t*>[]>
+      decoded;  // Values of the blocks already decoded, pinned tables only
+    std::unique_ptr<std::atomic<uint8_t>[]>
+             reads;  // Number of reads of each block, until it is decoded
     Piece    pieces[TBPIECES];        // Position pieces: the order of pieces defines the groups
     uint64_t groupIdx[TBPIECES + 1];  // Start index used for the encoding of the group's pieces
     int      groupLen[TBPIECES + 1];  // Number of pieces in a given group: KRKN -> (3, 1)
     uint16_t map_idx[4];              // WDLWin, WDLLoss, WDLCursedWin, WDLBlessedLoss (used in DTZ)
 };
 
+// Probe counters of a table, shown by the "tb stats" command. Times are in
+// nanoseconds, the probe time is the time spent decoding the position and
+// decompressing its value, without the mapping of the file. Only one probe in
+// TimingPeriod is timed, the times and the stalls are scaled accordingly.
+struct TableStats {
+    std::atomic<uint64_t> probes{0}, fails{0}, probeTime{0}, stalls{0}, stallTime{0};
+
+    void reset() { probes = fails = probeTime = stalls = stallTime = 0; }
+};
+
+constexpr unsigned TimingPeriod = 16;
+
+// Each thread counts its probes apart, so that the threads probing the same
+// table do not share the cache line of its counters. Only the owner thread
+// writes the counters, with plain loads and stores, and "tb stats" adds them
+// up. The counters of an exited thread are kept and reused by a new thread.
+struct ThreadStats {
+    std::unique_ptr<TableStats[]> tables;  // [2 * table index + 1 for DTZ]
+    std::atomic<uint64_t>         missingTableFails{0};
+    std::atomic<uint64_t>         cacheProbes{0}, cacheHits{0};  // WDL cache lookups
+    unsigned                      probes = 0;  // Picks the probes to time
+};
+
+std::mutex                                ThreadStatsMutex;
+std::vector<std::unique_ptr<ThreadStats>> AllThreadStats, FreeThreadStats;
+size_t                                    ThreadStatsTables;  // Size of the tables[] arrays
+
+void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+ThreadStats& thread_stats() {
+
+    thread_local struct Owner {
+        ThreadStats* stats = nullptr;
+
+        ~Owner() {
+            if (!stats)
+                return;
+
+            std::lock_guard<std::mutex> lk(ThreadStatsMutex);
+
+            auto it = std::find_if(AllThreadStats.begin(), AllThreadStats.end(),
+                                   [this](const auto& ts) { return ts.get() == stats; });
+
+            FreeThreadStats.push_back(std::move(*it));
+            AllThreadStats.erase(it);
+        }
+    } owner;
+
+    if (!owner.stats)
+    {
+        std::lock_guard<std::mutex> lk(ThreadStatsMutex);
+
+        if (FreeThreadStats.empty())
+        {
+            FreeThreadStats.push_back(std::make_unique<ThreadStats>());
+            FreeThreadStats.back()->tables = std::make_unique<TableStats[]>(ThreadStatsTables);
+        }
+
+        owner.stats = FreeThreadStats.back().get();
+        AllThreadStats.push_back(std::move(FreeThreadStats.back()));
+        FreeThreadStats.pop_back();
+    }
+
+    return *owner.stats;
+}
+
+// Resizes the counters of all the threads for a new set of tables. Called only
+// while nothing is probed.
+void reset_thread_stats(size_t tableCount) {
+
+    std::lock_guard<std::mutex> lk(ThreadStatsMutex);
+
+    ThreadStatsTables = tableCount;
+
+    for (auto* list : {&AllThreadStats, &FreeThreadStats})
+        for (auto& ts : *list)
+        {
+            ts->tables            = std::make_unique<TableStats[]>(tableCount);
+            ts->missingTableFails = ts->cacheProbes = ts->cacheHits = 0;
+        }
+}
+
 // struct TBTable contains indexing information to access the corresponding TBFile.
 // There are 2 types of TBTable, corresponding to a WDL or a DTZ file. TBTable
 // is populated at init time but the nested PairsData records are populated at
@@ -353,6 +624,9 @@ struct TBTable {
     static constexpr int Sides = Type == WDL ? 2 : 1;
 
     std::atomic_bool ready;
+    std::atomic_bool claimed;
+    std::atomic_bool prefetched;
+    bool             pinned;
     void*            baseAddress;
     uint8_t*         map;
     uint64_t         mapping;
@@ -363,18 +637,26 @@ struct TBTable {
     bool             hasUniquePieces;
     uint8_t          pawnCount[2];     // [Lead color / other color]
     PairsData        items[Sides][4];  // [wtm / btm][FILE_A..FILE_D or 0]
+    size_t           statsIndex;       // In the ThreadStats::tables[] arrays
 
     PairsData* get(int stm, int f) { return &items[stm % Sides][hasPawns ? f : 0]; }
 
     TBTable() :
         ready(false),
+        claimed(false),
+        prefetched(false),
+        pinned(false),
         baseAddress(nullptr) {}
     explicit TBTable(const std::string& code);
     explicit TBTable(const TBTable<WDL>& wdl);
 
     ~TBTable() {
-        if (baseAddress)
+        if (baseAddress && !pinned)  // Pinned files are owned by PinnedFiles
+        {
             TBFile::unmap(baseAddress, mapping);
+            UnmapEvents.fetch_add(1, std::memory_order_relaxed);
+            MappedBytes.fetch_sub(mapping, std::memory_order_relaxed);
+        }
     }
 };
 
@@ -436,33 +718,35 @@ class TBTables {
         }
     };
 
-    static constexpr int Size     = 1 << 12;  // 4K table, indexed by key's 12 lsb
     static constexpr int Overflow = 1;  // Number of elements allowed to map to the last bucket
 
-    Entry hashTable[Size + Overflow];
+    // Sized at init time to the number of tables found, indexed by key's lsb
+    std::vector<Entry> hashTable = std::vector<Entry>(1 + Overflow);
+    uint32_t           mask      = 0;
 
     std::deque<TBTable<WDL>> wdlTable;
     std::deque<TBTable<DTZ>> dtzTable;
+    std::vector<std::string> codes;
     size_t                   foundDTZFiles = 0;
     size_t                   foundWDLFiles = 0;
 
-    void insert(Key key, TBTable<WDL>* wdl, TBTable<DTZ>* dtz) {
-        uint32_t homeBucket = uint32_t(key) & (Size - 1);
+    bool insert(Key key, TBTable<WDL>* wdl, TBTable<DTZ>* dtz) {
+        uint32_t homeBucket = uint32_t(key) & mask;
         Entry    entry{key, wdl, dtz};
 
         // Ensure last element is empty to avoid overflow when looking up
-        for (uint32_t bucket = homeBucket; bucket < Size + Overflow - 1; ++bucket)
+        for (uint32_t bucket = homeBucket; bucket < hashTable.size() - 1; ++bucket)
         {
             Key otherKey = hashTable[bucket].key;
             if (otherKey == key || !hashTable[bucket].get<WDL>())
             {
                 hashTable[bucket] = entry;
-                return;
+                return true;
             }
 
             // Robin Hood hashing: If we've probed for longer than this element,
             // insert here and search for a new spot for the other element instead.
-            uint32_t otherHomeBucket = uint32_t(otherKey) & (Size - 1);
+            uint32_t otherHomeBucket = uint32_t(otherKey) & mask;
             if (otherHomeBucket > homeBucket)
             {
                 std::swap(entry, hashTable[bucket]);
@@ -470,28 +754,64 @@ class TBTables {
                 homeBucket = otherHomeBucket;
             }
         }
-        std::cerr << "TB hash table size too low!" << std::endl;
-        exit(EXIT_FAILURE);
+        return false;
     }
 
    public:
     template<TBType Type>
     TBTable<Type>* get(Key key) {
-        for (const Entry* entry = &hashTable[uint32_t(key) & (Size - 1)];; ++entry)
+        for (const Entry* entry = &hashTable[uint32_t(key) & mask];; ++entry)
         {
             if (entry->key == key || !entry->get<Type>())
                 return entry->get<Type>();
         }
     }
 
+    // File names of the tables, without extension, like "KRPvKR"
+    const std::vector<std::string>& names() const { return codes; }
+
     void clear() {
-        memset(hashTable, 0, sizeof(hashTable));
+        hashTable.assign(1 + Overflow, Entry());
+        mask = 0;
         wdlTable.clear();
         dtzTable.clear();
+        codes.clear();
         foundDTZFiles = 0;
         foundWDLFiles = 0;
+        reset_thread_stats(0);
+    }
+
+    // Builds the hash table once all the tables are added. There are two keys
+    // per table, one for each color, and the table is kept at most a quarter
+    // full. Should a bucket still overflow, the table is doubled.
+    void build() {
+        size_t size = 64;
+        while (size < 4 * wdlTable.size())
+            size *= 2;
+
+        for (bool done = false; !done; size *= 2)
+        {
+            hashTable.assign(size + Overflow, Entry());
+            mask = uint32_t(size - 1);
+            done = true;
+
+            for (size_t i = 0; done && i < wdlTable.size(); ++i)
+                done = insert(wdlTable[i].key, &wdlTable[i], &dtzTable[i])
+                    && insert(wdlTable[i].key2, &wdlTable[i], &dtzTable[i]);
+        }
+
+        reset_thread_stats(2 * codes.size());
+    }
+
+    // Bytes of the table objects and of the hash, their decoding tables aside
+    size_t memory_size() const {
+        return wdlTable.size() * sizeof(TBTable<WDL>) + dtzTable.size() * sizeof(TBTable<DTZ>)
+             + hashTable.size() * sizeof(Entry);
     }
 
+    void stats(std::ostream& os) const;
+    void reset_stats();
+
     void info() const {
         sync_cout << "info string Found " << foundWDLFiles << " WDL and " << foundDTZFiles
                   << " DTZ tablebase files (up to " << MaxCardinality << "-man)." << sync_endl;
@@ -502,8 +822,74 @@ class TBTables {
 
 TBTables TBTables;
 
+// ProbeCache keeps the results of recent probes, so that a position probed
+// again, by a later iteration, a later search or another thread, does not
+// decompress its table block once more. Each entry is a single word holding
+// the upper bits of the position key together with DataBits bits of result,
+// so it is read and written atomically without any locking. The stored data
+// must not be zero.
+template<int DataBits>
+class ProbeCache {
+
+    static constexpr uint64_t DataMask = (1ULL << DataBits) - 1;
+
+   public:
+    void resize(size_t mbSize) {
+        const size_t count = mbSize * 1024 * 1024 / sizeof(std::atomic<uint64_t>);
+
+        if (count != entryCount)
+        {
+            entryCount = count;
+            table = count ? make_unique_large_page<std::atomic<uint64_t>[]>(count) : nullptr;
+        }
+        else
+            for (size_t i = 0; i < entryCount; ++i)
+                table[i].store(0, std::memory_order_relaxed);
+    }
+
+    size_t memory_size() const { return entryCount * sizeof(std::atomic<uint64_t>); }
+
+    bool probe(Key key, uint64_t& data) const {
+        if (!entryCount)
+            return false;
+
+        const uint64_t e = table[mul_hi64(key, entryCount)].load(std::memory_order_relaxed);
+
+        // An empty entry never matches, as stored data is not zero
+        if (!e || (e ^ key) & ~DataMask)
+            return false;
+
+        data = e & DataMask;
+        return true;
+    }
+
+    void store(Key key, uint64_t data) {
+        assert(data && data <= DataMask);
+
+        if (entryCount)
+            table[mul_hi64(key, entryCount)].store((key & ~DataMask) | data,
+                                                   std::memory_order_relaxed);
+    }
+
+   private:
+    size_t                                entryCount = 0;
+    LargePagePtr<std::atomic<uint64_t>[]> table;
+};
+
+// The WDL cache stores the probe state, never FAIL, and the WDL score. The DTZ
+// cache stores a validity bit, the probe state and the DTZ. DTZ probes are far
+// fewer, they are done at the root and on the PV only, so the DTZ cache takes
+// a sixteenth of the size of the WDL cache. Both are keyed without the rule50
+// adjustment of Position::key(), as the results do not depend on it.
+ProbeCache<8>  WDLCache;
+ProbeCache<24> DTZCache;
+size_t         CacheSizeMb = 0;
+
+size_t dtz_cache_size(size_t mbSize) { return mbSize ? std::max(mbSize / 16, size_t(1)) : 0; }
+
 // If the corresponding file exists two new objects TBTable<WDL> and TBTable<DTZ>
-// are created and added to the lists and hash table. Called at init time.
+// are created and added to the lists, the hash table is built once all of them
+// are added. Called at init time.
 void TBTables::add(const std::vector<PieceType>& pieces) {
 
     std::string code;
@@ -512,29 +898,133 @@ void TBTables::add(const std::vector<PieceType>& pieces) {
         code += PieceToChar[pt];
     code.insert(code.find('K', 1), "v");
 
-    TBFile file_dtz(code + ".rtbz");  // KRK -> KRvK
-    if (file_dtz.is_open())
-    {
-        file_dtz.close();
+    if (TBFile::exists(code + ".rtbz"))  // KRK -> KRvK
         foundDTZFiles++;
-    }
 
-    TBFile file(code + ".rtbw");  // KRK -> KRvK
-
-    if (!file.is_open())  // Only WDL file is checked
+    if (!TBFile::exists(code + ".rtbw"))  // Only WDL file is checked
         return;
 
-    file.close();
     foundWDLFiles++;
 
     MaxCardinality = std::max(int(pieces.size()), MaxCardinality);
 
+    codes.push_back(code);
     wdlTable.emplace_back(code);
     dtzTable.emplace_back(wdlTable.back());
 
-    // Insert into the hash keys for both colors: KRvK with KR white and black
-    insert(wdlTable.back().key, &wdlTable.back(), &dtzTable.back());
-    insert(wdlTable.back().key2, &wdlTable.back(), &dtzTable.back());
+    wdlTable.back().statsIndex = 2 * (codes.size() - 1);
+    dtzTable.back().statsIndex = 2 * (codes.size() - 1) + 1;
+}
+
+// Memory for the decoded values of the hot blocks of the pinned tables, with a
+// fixed budget set by the "SyzygyPinnedDecode" option. Blocks are never freed
+// one by one, the whole arena is emptied when the tables are reloaded.
+class BlockArena {
+
+    LargePagePtr<uint16_t[]> values;
+    size_t                   capacity = 0;
+    std::atomic<size_t>      used{0};
+
+   public:
+    std::atomic<uint64_t> blocks{0};
+
+    void reset(size_t mbSize) {
+        const size_t count = mbSize * 1024 * 1024 / sizeof(uint16_t);
+
+        if (count != capacity)
+        {
+            values.reset();
+            values   = count ? make_unique_large_page<uint16_t[]>(count) : nullptr;
+            capacity = values ? count : 0;
+        }
+        used   = 0;
+        blocks = 0;
+    }
+
+    bool   enabled() const { return capacity; }
+    size_t used_bytes() const { return used * sizeof(uint16_t); }
+    size_t capacity_bytes() const { return capacity * sizeof(uint16_t); }
+
+    // Returns nullptr when the budget is exhausted
+    uint16_t* allocate(size_t count) {
+        size_t at = used.load(std::memory_order_relaxed);
+
+        do
+            if (at + count > capacity)
+                return nullptr;
+        while (!used.compare_exchange_weak(at, at + count, std::memory_order_relaxed));
+
+        blocks.fetch_add(1, std::memory_order_relaxed);
+        return values.get() + at;
+    }
+};
+
+BlockArena DecodedBlocks;
+
+// A block of a pinned table is decoded when it is read for the HotBlockReads
+// time, the later probes of the block then skip the Huffman decoding.
+constexpr int HotBlockReads = 8;
+
+void expand_symbol(const PairsData* d, Sym sym, uint16_t*& out, const uint16_t* end) {
+
+    if (out == end)
+        return;
+
+    if (!d->symlen[sym])
+    {
+        *out++ = d->btree[sym].get<LR::Left>();
+        return;
+    }
+
+    expand_symbol(d, d->btree[sym].get<LR::Left>(), out, end);
+    expand_symbol(d, d->btree[sym].get<LR::Right>(), out, end);
+}
+
+// Decodes all the values of a block, reading its symbols as decompress_pairs()
+// does and expanding each of them in full. Returns nullptr if the arena is full.
+uint16_t* decode_block(PairsData* d, uint32_t block) {
+
+    const size_t count  = size_t(d->blockLength[block]) + 1;
+    uint16_t*    values = DecodedBlocks.allocate(count);
+
+    if (!values)
+        return nullptr;
+
+    uint16_t* out = values;
+    uint32_t* ptr = (uint32_t*) (d->data + (uint64_t(block) * d->sizeofBlock));
+
+    uint64_t buf64 = number<uint64_t, BigEndian>(ptr);
+    ptr += 2;
+    int buf64Size = 64;
+
+    while (true)
+    {
+        int len = 0;
+
+        while (buf64 < d->base64[len])
+            ++len;
+
+        Sym sym = Sym((buf64 - d->base64[len]) >> (64 - len - d->minSymLen));
+        sym += number<Sym, LittleEndian>(&d->lowestSym[len]);
+
+        expand_symbol(d, sym, out, values + count);
+
+        if (out == values + count)
+            break;
+
+        len += d->minSymLen;
+        buf64 <<= len;
+        buf64Size -= len;
+
+        if (buf64Size <= 32)
+        {
+            buf64Size += 32;
+            buf64 |= uint64_t(number<uint32_t, BigEndian>(ptr++)) << (64 - buf64Size);
+        }
+    }
+
+    d->decoded[block].store(values, std::memory_order_release);
+    return values;
 }
 
 // TB tables are compressed with canonical Huffman code. The compressed data is divided into
@@ -597,6 +1087,17 @@ int decompress_pairs(PairsData* d, uint64_t idx) {
     while (offset > d->blockLength[block])
         offset -= d->blockLength[block++] + 1;
 
+    // Blocks of the pinned tables are decoded in full once they are hot
+    if (d->decoded)
+    {
+        if (const uint16_t* values = d->decoded[block].load(std::memory_order_acquire))
+            return values[offset];
+
+        if (d->reads[block].fetch_add(1, std::memory_order_relaxed) == HotBlockReads - 1)
+            if (const uint16_t* values = decode_block(d, block))
+                return values[offset];
+    }
+
     // Finally, we find the start address of our block of canonical Huffman symbols
     uint32_t* ptr = (uint32_t*) (d->data + (uint64_t(block) * d->sizeofBlock));
 
@@ -1204,26 +1705,44 @@ void set(T& e, uint8_t* data) {
             (d = e.get(i, f))->data = data;
             data += d->blocksNum * d->sizeofBlock;
         }
+
+    if (!e.pinned || !DecodedBlocks.enabled())
+        return;
+
+    for (File f = FILE_A; f <= maxFile; ++f)
+        for (int i = 0; i < sides; i++)
+            if (!((d = e.get(i, f))->flags & TBFlag::SingleValue))
+            {
+                d->decoded = std::make_unique<std::atomic<uint16_t*>[]>(d->blocksNum);
+                d->reads   = std::make_unique<std::atomic<uint8_t>[]>(d->blocksNum);
+            }
 }
 
+std::atomic<int>      TablesBeingMapped;
+std::atomic<uint64_t> MappingMisses;
+
 // If the TB file corresponding to the given position is already memory-mapped
 // then return its base address, otherwise, try to memory map and init it. Called
 // at every probe, memory map, and init only at first access. Function is thread
-// safe and can be called concurrently.
+// safe and can be called concurrently. The first thread to reach a table maps
+// it, meanwhile the other threads probing the same table do not wait for it but
+// get nullptr, as if the file did not exist. Distinct tables are mapped in
+// parallel.
 template<TBType Type>
 void* mapped(TBTable<Type>& e, const Position& pos) {
 
-    static std::mutex mutex;
-
     // Use 'acquire' to avoid a thread reading 'ready' == true while
     // another is still working. (compiler reordering may cause this).
     if (e.ready.load(std::memory_order_acquire))
         return e.baseAddress;  // Could be nullptr if file does not exist
 
-    std::scoped_lock<std::mutex> lk(mutex);
+    if (e.claimed.exchange(true, std::memory_order_relaxed))
+    {
+        MappingMisses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
 
-    if (e.ready.load(std::memory_order_relaxed))  // Recheck under lock
-        return e.baseAddress;
+    TablesBeingMapped.fetch_add(1, std::memory_order_relaxed);
 
     // Pieces strings in decreasing order for each color, like ("KPP","KR")
     std::string fname, w, b;
@@ -1236,50 +1755,400 @@ void* mapped(TBTable<Type>& e, const Position& pos) {
     fname =
       (e.key == pos.material_key() ? w + 'v' + b : b + 'v' + w) + (Type == WDL ? ".rtbw" : ".rtbz");
 
-    uint8_t* data = TBFile(fname).map(&e.baseAddress, &e.mapping, Type);
+    uint8_t* data = e.pinned ? TBFile(fname).load(&e.baseAddress, &e.mapping, Type)
+                             : TBFile(fname).map(&e.baseAddress, &e.mapping, Type);
 
     if (data)
+    {
         set(e, data);
+        MapEvents.fetch_add(1, std::memory_order_relaxed);
+
+        if (!e.pinned)
+            MappedBytes.fetch_add(e.mapping, std::memory_order_relaxed);
+    }
 
     e.ready.store(true, std::memory_order_release);
+    TablesBeingMapped.fetch_sub(1, std::memory_order_release);
     return e.baseAddress;
 }
 
-template<TBType Type, typename Ret = typename TBTable<Type>::Ret>
-Ret probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw) {
+// Probes fail while one of their tables is being mapped by another thread, for
+// instance by the prefetcher. Root probing must not fail spuriously, so it waits
+// for the mapping to complete and probes again.
+template<typename ProbeFn>
+bool probe_when_mapped(ProbeFn probe) {
 
-    if (pos.count<ALL_PIECES>() == 2)  // KvK
-        return Ret(WDLDraw);
+    while (true)
+    {
+        const uint64_t misses = MappingMisses.load(std::memory_order_relaxed);
 
-    TBTable<Type>* entry = TBTables.get<Type>(pos.material_key());
+        if (probe())
+            return true;
 
-    if (!entry || !mapped(*entry, pos))
-        return *result = FAIL, Ret();
+        if (MappingMisses.load(std::memory_order_relaxed) == misses)
+            return false;
 
-    return do_probe_table(pos, entry, wdl, result);
+        while (TablesBeingMapped.load(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
 }
 
-// For a position where the side to move has a winning capture it is not necessary
-// to store a winning value so the generator treats such positions as "don't care"
-// and tries to assign to it a value that improves the compression ratio. Similarly,
-// if the side to move has a drawing capture, then the position is at least drawn.
-// If the position is won, then the TB needs to store a win value. But if the
-// position is drawn, the TB may store a loss value if that is better for compression.
-// All of this means that during probing, the engine must look at captures and probe
-// their results and must probe the position itself. The "best" result of these
-// probes is the correct result for the position.
-// DTZ tables do not store values when a following move is a zeroing winning move
-// (winning capture or winning pawn move). Also, DTZ store wrong values for positions
-// where the best move is an ep-move (even if losing). So in all these cases set
-// the state to ZEROING_BEST_MOVE.
-template<bool CheckZeroingMoves>
-WDLScore search(Position& pos, ProbeState* result) {
+// Sets up the position of a FEN read from a file of positions to probe, and
+// returns false when it cannot be probed. The probing code relies on a legal
+// position: one king of each color, no pawns on the first and last ranks, and
+// the side not to move not in check. The kings are counted before setting up
+// the position, which takes them for granted.
+bool is_probeable(Position& pos, const std::string& fen, StateInfo* st) {
 
-    WDLScore  value, bestValue = WDLLoss;
-    StateInfo st;
+    const std::string_view placement = std::string_view(fen).substr(0, fen.find(' '));
 
-    auto   moveList   = MoveList<LEGAL>(pos);
-    size_t totalCount = moveList.size(), moveCount = 0;
+    if (std::count(placement.begin(), placement.end(), 'K') != 1
+        || std::count(placement.begin(), placement.end(), 'k') != 1)
+        return false;
+
+    pos.set(fen, false, st);
+
+    return pos.count<ALL_PIECES>() <= MaxCardinality && !pos.can_castle(ANY_CASTLING)
+        && !(pos.pieces(PAWN) & (Rank1BB | Rank8BB))
+        && !(pos.attackers_to(pos.square<KING>(~pos.side_to_move()))
+             & pos.pieces(pos.side_to_move()));
+}
+
+// Probes taking longer than this are counted as stalled: a probe served from
+// memory takes a few microseconds, one that page faults on a cold block of the
+// file has to wait for the disk.
+constexpr auto StallThreshold = std::chrono::microseconds(100);
+
+std::atomic<uint64_t> StallCount, StallTime;  // Time in microseconds
+std::atomic<uint64_t> PrefetchedBytes;
+
+// TBPrefetcher maps the WDL tables that the search is about to reach and asks
+// the OS to read them in ahead of time, so that the first probes into a new
+// table do not stall a search thread on page faults. It runs on its own thread,
+// started at the first request. The index sections of a table are always read
+// ahead, the whole file only while the readahead budget is not used up.
+class TBPrefetcher {
+   public:
+    ~TBPrefetcher() {
+        {
+            std::scoped_lock<std::mutex> lk(mutex);
+            exit = true;
+        }
+        cv.notify_all();
+
+        if (thread.joinable())
+            thread.join();
+    }
+
+    // Replaces the pending requests with the given tables, in TB file naming
+    // like "KRPvKR", most urgent first.
+    void push(std::deque<std::string>&& codes, size_t budgetBytes) {
+        std::scoped_lock<std::mutex> lk(mutex);
+
+        if (!thread.joinable())
+            thread = std::thread(&TBPrefetcher::idle_loop, this);
+
+        queue  = std::move(codes);
+        budget = budgetBytes;
+        cv.notify_all();
+    }
+
+    // Drops the pending requests and waits for the current one, if any. Must
+    // be called before the tables are freed.
+    void clear() {
+        std::unique_lock<std::mutex> lk(mutex);
+        queue.clear();
+        cv.wait(lk, [&] { return !busy; });
+    }
+
+   private:
+    void idle_loop() {
+        std::unique_lock<std::mutex> lk(mutex);
+
+        while (true)
+        {
+            cv.wait(lk, [&] { return exit || !queue.empty(); });
+
+            if (exit)
+                return;
+
+            const std::string code = queue.front();
+            const size_t      left = budget - std::min(budget, size_t(PrefetchedBytes));
+            queue.pop_front();
+            busy = true;
+            lk.unlock();
+
+            PrefetchedBytes += prefetch(code, left);
+
+            lk.lock();
+            busy = false;
+            cv.notify_all();
+        }
+    }
+
+    // Returns the number of bytes read ahead
+    static size_t prefetch(const std::string& code, [[maybe_unused]] size_t budgetLeft) {
+
+        StateInfo st;
+        Position  pos;
+        pos.set(code, WHITE, &st);
+
+        TBTable<WDL>* e = TBTables.get<WDL>(pos.material_key());
+
+        if (!e || e->prefetched.exchange(true) || !mapped(*e, pos))
+            return 0;
+
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+        // The header and the index sections come before the compressed data
+        const size_t indexSize = size_t(e->get(0, FILE_A)->data - (uint8_t*) e->baseAddress);
+        const size_t size      = e->mapping <= budgetLeft ? e->mapping : indexSize;
+
+        madvise(e->baseAddress, size, MADV_WILLNEED);
+        return size;
+#else
+        return 0;
+#endif
+    }
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::deque<std::string> queue;
+    std::thread             thread;
+    size_t                  budget = 0;
+    bool                    busy = false, exit = false;
+};
+
+TBPrefetcher TBPrefetcher;
+
+// Queues for prefetching the WDL tables of the positions reachable from the
+// given one by capturing up to two pieces, when they are within the probing
+// limit. Pawn promotions are not considered.
+void prefetch_tables(const Position& pos, int cardinality, size_t budgetBytes) {
+
+    constexpr int MaxCaptures = 2;
+
+    const int pieceCount = popcount(pos.pieces());
+
+    if (pieceCount > cardinality + MaxCaptures)
+        return;
+
+    // Non-king pieces of each side, strongest first
+    std::string pieces[COLOR_NB];
+    for (Color c : {WHITE, BLACK})
+        for (PieceType pt = QUEEN; pt >= PAWN; --pt)
+            pieces[c] += std::string(popcount(pos.pieces(c, pt)), PieceToChar[pt]);
+
+    const std::string all = pieces[WHITE] + pieces[BLACK];
+    const size_t      n   = all.size(), whites = pieces[WHITE].size();
+
+    std::deque<std::string> codes;
+
+    // Adds the material left once the pieces at the given indices of 'all' are
+    // captured, index n meaning no piece
+    auto add = [&](size_t i, size_t j) {
+        std::string code[COLOR_NB] = {"K", "K"};
+
+        for (size_t k = 0; k < n; ++k)
+            if (k != i && k != j)
+                code[k >= whites] += all[k];
+
+        const std::string name = code[WHITE] + 'v' + code[BLACK];
+
+        if (std::find(codes.begin(), codes.end(), name) == codes.end())
+            codes.push_back(name);
+    };
+
+    // Fewer captures first, they are reached sooner
+    const int minCaptures = pieceCount - cardinality;
+
+    if (minCaptures <= 0)
+        add(n, n);
+
+    if (minCaptures <= 1)
+        for (size_t i = 0; i < n; ++i)
+            add(i, n);
+
+    for (size_t i = 0; i < n; ++i)
+        for (size_t j = i + 1; j < n; ++j)
+            add(i, j);
+
+    TBPrefetcher.push(std::move(codes), budgetBytes);
+}
+
+template<TBType Type, typename Ret = typename TBTable<Type>::Ret>
+Ret probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw) {
+
+    if (pos.count<ALL_PIECES>() == 2)  // KvK
+        return Ret(WDLDraw);
+
+    using namespace std::chrono;
+
+    TBTable<Type>* entry = TBTables.get<Type>(pos.material_key());
+    ThreadStats&   ts    = thread_stats();
+
+    if (!entry)
+    {
+        bump(ts.missingTableFails, 1);
+        return *result = FAIL, Ret();
+    }
+
+    TableStats& stats = ts.tables[entry->statsIndex];
+    const bool  timed = ++ts.probes % TimingPeriod == 0;
+    const auto  start = timed ? steady_clock::now() : steady_clock::time_point();
+
+    if (!mapped(*entry, pos))
+    {
+        bump(stats.fails, 1);
+        return *result = FAIL, Ret();
+    }
+
+    bump(stats.probes, 1);
+
+    if (!timed)
+        return do_probe_table(pos, entry, wdl, result);
+
+    const auto probeStart = steady_clock::now();
+    Ret        value      = do_probe_table(pos, entry, wdl, result);
+    const auto end        = steady_clock::now();
+
+    bump(stats.probeTime, TimingPeriod * duration_cast<nanoseconds>(end - probeStart).count());
+
+    if (end - start > StallThreshold)
+    {
+        const auto stall = TimingPeriod * duration_cast<nanoseconds>(end - start).count();
+
+        bump(stats.stalls, TimingPeriod);
+        bump(stats.stallTime, stall);
+        StallCount.fetch_add(TimingPeriod, std::memory_order_relaxed);
+        StallTime.fetch_add(stall / 1000, std::memory_order_relaxed);
+    }
+
+    return value;
+}
+
+// Writes the global probe counters, then those of each table that was probed,
+// the most probed first, failed probes included. The tables that stall often
+// are the ones that gain the most from faster storage.
+void TBTables::stats(std::ostream& os) const {
+
+    struct Row {
+        std::string       name;
+        const TableStats* stats;
+    };
+
+    // Add up the counters of the threads
+    std::vector<TableStats> totals(2 * codes.size());
+    uint64_t                missingTableFails = 0, cacheProbes = 0, cacheHits = 0;
+
+    {
+        std::lock_guard<std::mutex> lk(ThreadStatsMutex);
+
+        for (auto* list : {&AllThreadStats, &FreeThreadStats})
+            for (auto& ts : *list)
+            {
+                missingTableFails += ts->missingTableFails;
+                cacheProbes += ts->cacheProbes;
+                cacheHits += ts->cacheHits;
+
+                for (size_t i = 0; i < totals.size(); ++i)
+                {
+                    totals[i].probes += ts->tables[i].probes;
+                    totals[i].fails += ts->tables[i].fails;
+                    totals[i].probeTime += ts->tables[i].probeTime;
+                    totals[i].stalls += ts->tables[i].stalls;
+                    totals[i].stallTime += ts->tables[i].stallTime;
+                }
+            }
+    }
+
+    std::vector<Row> rows;
+    uint64_t         probes = 0, fails = 0;
+
+    for (size_t i = 0; i < codes.size(); ++i)
+        for (const Row& row :
+             {Row{codes[i] + ".rtbw", &totals[2 * i]}, Row{codes[i] + ".rtbz", &totals[2 * i + 1]}})
+            if (row.stats->probes || row.stats->fails)
+            {
+                rows.push_back(row);
+                probes += row.stats->probes;
+                fails += row.stats->fails;
+            }
+
+    std::stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+        return a.stats->probes + a.stats->fails > b.stats->probes + b.stats->fails;
+    });
+
+    os << "Tablebase probes: " << probes << ", failed " << fails + missingTableFails
+       << " (no table " << missingTableFails << ", file missing or being mapped " << fails
+       << ", of which being mapped " << MappingMisses << ")"
+       << "\nFiles mapped " << MapEvents << ", unmapped " << UnmapEvents << ", read ahead "
+       << (PrefetchedBytes >> 20) << " MB, stalled probes " << StallCount << " for "
+       << StallTime / 1000 << " ms";
+
+    if (PinnedCount)
+        os << "\nPinned files " << PinnedCount << ", " << (PinnedBytes >> 20) << " MB, decoded blocks "
+           << DecodedBlocks.blocks << " in " << (DecodedBlocks.used_bytes() >> 20) << " of "
+           << PinnedDecodeMb << " MB";
+
+    if (cacheProbes)
+        os << "\nWDL cache hits " << cacheHits << " of " << cacheProbes << " lookups ("
+           << 100 * cacheHits / cacheProbes << "%)";
+
+    if (rows.empty())
+        return;
+
+    os << "\n\n" << std::left << std::setw(16) << "Table" << std::right << std::setw(12) << "Probes"
+       << std::setw(10) << "Fails" << std::setw(10) << "Avg us" << std::setw(10) << "Stalls"
+       << std::setw(10) << "Stall ms";
+
+    for (const Row& row : rows)
+        os << "\n" << std::left << std::setw(16) << row.name << std::right << std::setw(12)
+           << row.stats->probes << std::setw(10) << row.stats->fails << std::setw(10)
+           << std::fixed << std::setprecision(2)
+           << double(row.stats->probeTime) / std::max<uint64_t>(row.stats->probes, 1) / 1000
+           << std::setw(10) << row.stats->stalls << std::setw(10) << row.stats->stallTime / 1000000;
+}
+
+void TBTables::reset_stats() {
+
+    {
+        std::lock_guard<std::mutex> lk(ThreadStatsMutex);
+
+        for (auto* list : {&AllThreadStats, &FreeThreadStats})
+            for (auto& ts : *list)
+            {
+                for (size_t i = 0; i < 2 * codes.size(); ++i)
+                    ts->tables[i].reset();
+
+                ts->missingTableFails = ts->cacheProbes = ts->cacheHits = 0;
+            }
+    }
+
+    MapEvents = UnmapEvents = MappingMisses = 0;
+    StallCount = StallTime = 0;
+}
+
+// For a position where the side to move has a winning capture it is not necessary
+// to store a winning value so the generator treats such positions as "don't care"
+// and tries to assign to it a value that improves the compression ratio. Similarly,
+// if the side to move has a drawing capture, then the position is at least drawn.
+// If the position is won, then the TB needs to store a win value. But if the
+// position is drawn, the TB may store a loss value if that is better for compression.
+// All of this means that during probing, the engine must look at captures and probe
+// their results and must probe the position itself. The "best" result of these
+// probes is the correct result for the position.
+// DTZ tables do not store values when a following move is a zeroing winning move
+// (winning capture or winning pawn move). Also, DTZ store wrong values for positions
+// where the best move is an ep-move (even if losing). So in all these cases set
+// the state to ZEROING_BEST_MOVE.
+template<bool CheckZeroingMoves>
+WDLScore search(Position& pos, ProbeState* result) {
+
+    WDLScore  value, bestValue = WDLLoss;
+    StateInfo st;
+
+    auto   moveList   = MoveList<LEGAL>(pos);
+    size_t totalCount = moveList.size(), moveCount = 0;
 
     for (const Move move : moveList)
     {
@@ -1332,20 +2201,80 @@ WDLScore search(Position& pos, ProbeState* result) {
     return *result = OK, value;
 }
 
+// Loads the WDL and DTZ files of the pinned tables, at init time. The files
+// read for a previous init are reused, the ones not pinned anymore are freed.
+void pin_tables() {
+
+    PinnedCount = PinnedBytes = 0;
+
+    for (auto& [name, file] : PinnedFiles)
+        file.used = false;
+
+    DecodedBlocks.reset(PinnedCodes.empty() ? 0 : PinnedDecodeMb);
+
+    for (const std::string& code : PinnedCodes)
+    {
+        const auto& names = TBTables.names();
+
+        if (std::find(names.begin(), names.end(), code) == names.end())
+        {
+            sync_cout << "info string Pinned tablebase " << code << " not found" << sync_endl;
+            continue;
+        }
+
+        StateInfo st;
+        Position  pos;
+        pos.set(code, WHITE, &st);
+
+        TBTable<WDL>* wdl = TBTables.get<WDL>(pos.material_key());
+        TBTable<DTZ>* dtz = TBTables.get<DTZ>(pos.material_key());
+
+        // The prefetcher must not read ahead the pinned tables
+        wdl->pinned = wdl->prefetched = dtz->pinned = dtz->prefetched = true;
+
+        if (mapped(*wdl, pos))
+            PinnedCount++, PinnedBytes += wdl->mapping;
+
+        if (mapped(*dtz, pos))
+            PinnedCount++, PinnedBytes += dtz->mapping;
+    }
+
+    for (auto it = PinnedFiles.begin(); it != PinnedFiles.end();)
+        it = it->second.used ? std::next(it) : PinnedFiles.erase(it);
+
+    if (!PinnedCodes.empty())
+        sync_cout << "info string Pinned " << PinnedCount << " tablebase files in memory, "
+                  << (PinnedBytes >> 20) << " MB, " << PinnedDecodeMb
+                  << " MB for decoded blocks" << sync_endl;
+}
+
 }  // namespace
 
 
 // Called at startup and after every change to
 // "SyzygyPath" UCI option to (re)create the various tables. It is not thread
-// safe, nor it needs to be.
-void Tablebases::init(const std::string& paths) {
+// safe, nor it needs to be. At a new game the tables are recreated from the
+// file list of the previous call, the directories are scanned again only when
+// the paths change or a rescan is requested.
+void Tablebases::init(const std::string& paths, bool rescan) {
 
+    TBPrefetcher.clear();
     TBTables.clear();
+    StallCount = StallTime = PrefetchedBytes = 0;
     MaxCardinality = 0;
     TBFile::Paths  = paths;
 
+    if (rescan || paths.empty())
+        PinnedFiles.clear();
+
     if (paths.empty())
+    {
+        PinnedCount = PinnedBytes = 0;
+        DecodedBlocks.reset(0);
         return;
+    }
+
+    TBFile::scan(rescan);
 
     // MapB1H1H7[] encodes a square below a1-h8 diagonal to 0..27
     int code = 0;
@@ -1484,7 +2413,82 @@ void Tablebases::init(const std::string& paths) {
         }
     }
 
+    TBTables.build();
     TBTables.info();
+    pin_tables();
+
+    // The caches are only allocated when some tables are found, and are emptied
+    // whenever the tables are reloaded, that is also at every new game.
+    set_cache_size(CacheSizeMb);
+}
+
+// Called when the "SyzygyCache" option changes, the new size of the WDL cache
+// is in MB. Zero disables both caches.
+void Tablebases::set_cache_size(size_t mbSize) {
+
+    CacheSizeMb = mbSize;
+    WDLCache.resize(MaxCardinality ? CacheSizeMb : 0);
+    DTZCache.resize(MaxCardinality ? dtz_cache_size(CacheSizeMb) : 0);
+}
+
+// Called when the "SyzygyPinned" or "SyzygyPinnedDecode" options change, the
+// tables are pinned at the next init. Table names are separated by spaces or
+// commas, like "KRPvKR, KQvKR".
+void Tablebases::set_pinned(const std::string& codes, size_t decodeMb) {
+
+    std::string code;
+    PinnedCodes.clear();
+    PinnedDecodeMb = decodeMb;
+
+    for (char c : codes + " ")
+        if (std::isalpha(c))
+            code += c == 'v' || c == 'V' ? 'v' : char(std::toupper(c));
+        else if (!code.empty())
+        {
+            PinnedCodes.push_back(code);
+            code.clear();
+        }
+}
+
+// Returns the memory held by the tablebases, for the "memory" command and the
+// "MemoryBudget" option.
+Tablebases::MemoryUsage Tablebases::memory_usage() {
+
+    MemoryUsage usage;
+    usage.mapped = MappedBytes.load(std::memory_order_relaxed);
+    usage.pinned = DecodedBlocks.capacity_bytes();
+    usage.caches = WDLCache.memory_size() + DTZCache.memory_size();
+    usage.tables = TBTables.memory_size();
+
+    for (const auto& [path, file] : PinnedFiles)
+        usage.pinned += file.size;
+
+    return usage;
+}
+
+// Returns the size in MB of the WDL cache, as last set by set_cache_size()
+size_t Tablebases::cache_size() { return CacheSizeMb; }
+
+// Returns the bytes taken by the caches for a WDL cache of the given size in MB
+size_t Tablebases::cache_memory_size(size_t mbSize) {
+    return MaxCardinality ? (mbSize + dtz_cache_size(mbSize)) << 20 : 0;
+}
+
+// Returns the report of the "tb stats" command
+std::string Tablebases::stats() {
+
+    std::stringstream ss;
+    TBTables.stats(ss);
+    return ss.str();
+}
+
+// Zeroes the counters of the "tb stats" command
+void Tablebases::reset_stats() { TBTables.reset_stats(); }
+
+// Returns the counters of the probes that stalled and of the table data read
+// ahead, since the tables were last loaded.
+ProbeStats Tablebases::probe_stats() {
+    return {StallCount, StallTime, PrefetchedBytes};
 }
 
 // Probe the WDL table for a particular position.
@@ -1497,37 +2501,191 @@ void Tablebases::init(const std::string& paths) {
 //  2 : win
 WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 
-    *result = OK;
-    return search<false>(pos, result);
+    uint64_t data;
+    bool     hit = WDLCache.probe(pos.state()->key, data);
+
+    if (CacheSizeMb)
+    {
+        ThreadStats& ts = thread_stats();
+        bump(ts.cacheProbes, 1);
+        bump(ts.cacheHits, hit);
+    }
+
+    if (hit)
+        return *result = ProbeState(data >> 3), WDLScore(int(data & 7) - 2);
+
+    *result      = OK;
+    WDLScore wdl = search<false>(pos, result);
+
+    if (*result != FAIL)
+        WDLCache.store(pos.state()->key, uint64_t(*result) << 3 | uint64_t(wdl + 2));
+
+    return wdl;
 }
 
-// Probe the DTZ table for a particular position.
-// If *result != FAIL, the probe was successful.
-// The return value is from the point of view of the side to move:
-//         n < -100 : loss, but draw under 50-move rule
-// -100 <= n < -1   : loss in n ply (assuming 50-move counter == 0)
-//        -1        : loss, the side to move is mated
-//         0        : draw
-//     1 < n <= 100 : win in n ply (assuming 50-move counter == 0)
-//   100 < n        : win, but draw under 50-move rule
-//
-// The return value n can be off by 1: a return value -n can mean a loss
-// in n+1 ply and a return value +n can mean a win in n+1 ply. This
-// cannot happen for tables with positions exactly on the "edge" of
-// the 50-move rule.
-//
-// This implies that if dtz > 0 is returned, the position is certainly
-// a win if dtz + 50-move-counter <= 99. Care must be taken that the engine
-// picks moves that preserve dtz + 50-move-counter <= 99.
-//
-// If n = 100 immediately after a capture or pawn move, then the position
-// is also certainly a win, and during the whole phase until the next
-// capture or pawn move, the inequality to be preserved is
-// dtz + 50-move-counter <= 100.
-//
-// In short, if a move is available resulting in dtz + 50-move-counter <= 99,
-// then do not accept moves leading to dtz + 50-move-counter == 100.
-int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
+namespace {
+
+// Returns the FEN of a random legal position with the material of the given
+// table, like "KRPvKR", white having the first set of pieces.
+std::string random_position(const std::string& code, PRNG& rng) {
+
+    StateInfo st;
+    Position  pos;
+
+    while (true)
+    {
+        char  board[SQUARE_NB] = {};
+        Color c                = WHITE;
+
+        for (char pc : code)
+        {
+            if (pc == 'v')
+            {
+                c = BLACK;
+                continue;
+            }
+
+            Square s;
+            do
+                s = Square(rng.rand<uint64_t>() % SQUARE_NB);
+            while (board[s] || (pc == 'P' && (rank_of(s) == RANK_1 || rank_of(s) == RANK_8)));
+
+            board[s] = char(c == WHITE ? pc : std::tolower(pc));
+        }
+
+        std::string fen;
+        for (Rank r = RANK_8; r >= RANK_1; --r)
+        {
+            for (File f = FILE_A; f <= FILE_H; ++f)
+            {
+                const char pc = board[make_square(f, r)];
+
+                if (!pc && !fen.empty() && std::isdigit(fen.back()))
+                    ++fen.back();
+                else
+                    fen += pc ? pc : '1';
+            }
+            fen += r > RANK_1 ? "/" : "";
+        }
+        fen += rng.rand<uint64_t>() & 1 ? " w - - 0 1" : " b - - 0 1";
+
+        // The side not to move must not be in check
+        pos.set(fen, false, &st);
+        if (!(pos.attackers_to(pos.square<KING>(~pos.side_to_move()))
+              & pos.pieces(pos.side_to_move())))
+            return fen;
+    }
+}
+
+}  // namespace
+
+// Measures the probe latency when many threads enter the tablebases at once.
+// The tables are reloaded first, so that the threads also race to map them,
+// then each thread probes random positions of all the tables, bypassing the
+// WDL cache, for the given time.
+std::string Tablebases::stress_test(size_t threadCount, int ms) {
+
+    if (!MaxCardinality)
+        return "No tablebases found";
+
+    init(TBFile::Paths, false);
+
+    constexpr int PositionsPerTable = 16;
+
+    std::vector<std::string> fens;
+    PRNG                     rng(1070372);
+
+    for (const std::string& code : TBTables.names())
+        for (int i = 0; i < PositionsPerTable; ++i)
+            fens.push_back(random_position(code, rng));
+
+    // Probe latencies are recorded in power of two buckets of nanoseconds
+    struct Results {
+        uint64_t probes = 0, misses = 0, totalNs = 0, maxNs = 0;
+        uint64_t histogram[64] = {};
+    };
+
+    const uint64_t           mappingMisses = MappingMisses;
+    std::vector<Results>     results(threadCount);
+    std::vector<std::thread> threads;
+    std::atomic<bool>        start(false);
+    const auto               deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+
+    for (size_t idx = 0; idx < threadCount; ++idx)
+        threads.emplace_back([&, idx]() {
+            Results&  r = results[idx];
+            StateInfo st;
+            Position  pos;
+
+            while (!start.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
+            for (size_t i = idx; std::chrono::steady_clock::now() < deadline; i += threadCount)
+            {
+                pos.set(fens[i % fens.size()], false, &st);
+
+                ProbeState result = OK;
+                const auto t0     = std::chrono::steady_clock::now();
+
+                search<false>(pos, &result);
+
+                const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - t0)
+                                      .count();
+
+                r.probes++;
+                r.misses += result == FAIL;
+                r.totalNs += ns;
+                r.maxNs = std::max(r.maxNs, ns);
+                r.histogram[ns ? msb(ns) : 0]++;
+            }
+        });
+
+    start.store(true, std::memory_order_release);
+
+    for (auto& th : threads)
+        th.join();
+
+    Results total;
+    for (const Results& r : results)
+    {
+        total.probes += r.probes;
+        total.misses += r.misses;
+        total.totalNs += r.totalNs;
+        total.maxNs = std::max(total.maxNs, r.maxNs);
+
+        for (int b = 0; b < 64; ++b)
+            total.histogram[b] += r.histogram[b];
+    }
+
+    // Upper bound, in microseconds, of the latency of the given share of probes
+    auto percentile = [&](double share) {
+        uint64_t count = 0;
+        int      b     = 0;
+
+        while (b < 63 && (count += total.histogram[b]) < share * total.probes)
+            ++b;
+
+        return double(2ULL << b) / 1000;
+    };
+
+    std::stringstream ss;
+    ss << "Tablebase stress test: " << threadCount << " threads, " << total.probes
+       << " probes in " << ms << " ms, " << total.misses << " failed, "
+       << MappingMisses - mappingMisses << " tables found being mapped by another thread"
+       << "\nProbe latency: average " << std::fixed
+       << std::setprecision(1) << double(total.totalNs) / std::max<uint64_t>(total.probes, 1) / 1000
+       << " us, 50% under " << percentile(0.5) << " us, 99% under " << percentile(0.99)
+       << " us, max " << double(total.maxNs) / 1000 << " us";
+
+    return ss.str();
+}
+
+namespace {
+
+// Probes the DTZ tables for probe_dtz(), without the cache
+int probe_dtz_table(Position& pos, ProbeState* result) {
 
     *result      = OK;
     WDLScore wdl = search<true>(pos, result);
@@ -1566,7 +2724,7 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
         dtz = zeroing ? -dtz_before_zeroing(search<false>(pos, result)) : -probe_dtz(pos, result);
 
         // If the move mates, force minDTZ to 1
-        if (dtz == 1 && pos.checkers() && MoveList<LEGAL>(pos).size() == 0)
+        if (dtz == 1 && pos.checkers() && move_count<LEGAL>(pos) == 0)
             minDTZ = 1;
 
         // Convert result from 1-ply search. Zeroing moves are already accounted
@@ -1588,6 +2746,210 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
     return minDTZ == 0xFFFF ? -1 : minDTZ;
 }
 
+}  // namespace
+
+// Probe the DTZ table for a particular position.
+// If *result != FAIL, the probe was successful.
+// The return value is from the point of view of the side to move:
+//         n < -100 : loss, but draw under 50-move rule
+// -100 <= n < -1   : loss in n ply (assuming 50-move counter == 0)
+//        -1        : loss, the side to move is mated
+//         0        : draw
+//     1 < n <= 100 : win in n ply (assuming 50-move counter == 0)
+//   100 < n        : win, but draw under 50-move rule
+//
+// The return value n can be off by 1: a return value -n can mean a loss
+// in n+1 ply and a return value +n can mean a win in n+1 ply. This
+// cannot happen for tables with positions exactly on the "edge" of
+// the 50-move rule.
+//
+// This implies that if dtz > 0 is returned, the position is certainly
+// a win if dtz + 50-move-counter <= 99. Care must be taken that the engine
+// picks moves that preserve dtz + 50-move-counter <= 99.
+//
+// If n = 100 immediately after a capture or pawn move, then the position
+// is also certainly a win, and during the whole phase until the next
+// capture or pawn move, the inequality to be preserved is
+// dtz + 50-move-counter <= 100.
+//
+// In short, if a move is available resulting in dtz + 50-move-counter <= 99,
+// then do not accept moves leading to dtz + 50-move-counter == 100.
+int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
+
+    uint64_t data;
+
+    if (DTZCache.probe(pos.state()->key, data))
+        return *result = ProbeState(int(data >> 16 & 3) - 1), int16_t(data);
+
+    const int dtz = probe_dtz_table(pos, result);
+
+    if (*result != FAIL)
+        DTZCache.store(pos.state()->key, 1 << 23 | uint64_t(*result + 1) << 16 | uint16_t(dtz));
+
+    return dtz;
+}
+
+// Probes WDL and DTZ of many positions, on all the threads of the pool. The
+// positions are probed in the order of their material key, so that the probes
+// of a table follow each other and reuse its decompressed blocks. Positions
+// which cannot be probed, as those with castling rights or invalid ones, are
+// left with FAIL states.
+void Tablebases::probe_batch(std::vector<BatchProbe>& batch, ThreadPool& threads) {
+
+    constexpr size_t Chunk = 1024;  // Positions taken at once by a thread
+
+    std::vector<std::pair<Key, size_t>> order(batch.size());
+    std::vector<PackedPosition>         packed(batch.size());  // Unset when not probed
+    std::atomic<size_t>                 next(0);
+
+    auto on_all_threads = [&](auto job) {
+        next = 0;
+
+        for (size_t i = 0; i < threads.num_threads(); ++i)
+            threads.run_on_thread(i, job);
+
+        for (size_t i = 0; i < threads.num_threads(); ++i)
+            threads.wait_on_thread(i);
+    };
+
+    // Each FEN is parsed once, the positions to probe are kept packed
+    on_all_threads([&]() {
+        StateInfo st;
+        Position  pos;
+
+        for (size_t begin; (begin = next.fetch_add(Chunk)) < batch.size();)
+            for (size_t i = begin; i < std::min(begin + Chunk, batch.size()); ++i)
+            {
+                order[i] = {0, i};
+
+                if (!is_probeable(pos, batch[i].fen, &st))
+                    continue;
+
+                order[i].first = pos.material_key();
+                packed[i]      = pos.encode();
+            }
+    });
+
+    std::sort(order.begin(), order.end());
+
+    on_all_threads([&]() {
+        StateInfo st;
+        Position  pos;
+
+        for (size_t begin; (begin = next.fetch_add(Chunk)) < batch.size();)
+            for (size_t i = begin; i < std::min(begin + Chunk, batch.size()); ++i)
+            {
+                BatchProbe& b = batch[order[i].second];
+
+                if (!packed[order[i].second].occupied)
+                    continue;
+
+                pos.decode(packed[order[i].second], &st);
+
+                // A table being mapped by another thread is not a missing table
+                probe_when_mapped([&]() {
+                    b.wdl = probe_wdl(pos, &b.wdlState);
+                    return b.wdlState != FAIL;
+                });
+
+                probe_when_mapped([&]() {
+                    b.dtz = probe_dtz(pos, &b.dtzState);
+                    return b.dtzState != FAIL;
+                });
+            }
+    });
+}
+
+// Probes the positions of a file, one FEN per line, by batches. The results
+// are written in the order of the input, as CSV lines "fen,wdl,dtz" with empty
+// fields for failed probes or, when the output file name ends in ".bin", as
+// records of 4 bytes: WDL as int8_t, flags as uint8_t (1 when WDL is found, 2
+// when DTZ is found), DTZ as little-endian int16_t.
+std::string
+Tablebases::probe_file(const std::string& input, const std::string& output, ThreadPool& threads) {
+
+    constexpr size_t BatchSize = 1 << 20;
+
+    if (!MaxCardinality)
+        return "No tablebases found";
+
+    std::ifstream in(input);
+
+    if (!in)
+        return "Unable to open file " + input;
+
+    const bool binary = output.size() > 4 && output.compare(output.size() - 4, 4, ".bin") == 0;
+
+    std::ofstream out(output, binary ? std::ios::binary : std::ios::out);
+
+    if (!out)
+        return "Unable to open file " + output;
+
+    std::vector<BatchProbe> batch;
+    std::string             line;
+    uint64_t                positions = 0, wdlFound = 0, dtzFound = 0;
+    const TimePoint         start     = now();
+
+    while (true)
+    {
+        batch.clear();
+
+        while (batch.size() < BatchSize && std::getline(in, line))
+        {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+
+            if (!line.empty())
+                batch.emplace_back().fen = line;
+        }
+
+        if (batch.empty())
+            break;
+
+        probe_batch(batch, threads);
+
+        for (const BatchProbe& b : batch)
+        {
+            wdlFound += b.wdlState != FAIL;
+            dtzFound += b.dtzState != FAIL;
+
+            if (binary)
+            {
+                const int16_t dtz       = int16_t(b.dtz);
+                const uint8_t record[4] = {
+                  uint8_t(int8_t(b.wdl)),
+                  uint8_t((b.wdlState != FAIL) | (b.dtzState != FAIL) << 1),
+                  uint8_t(uint16_t(dtz) & 0xFF), uint8_t(uint16_t(dtz) >> 8)};
+                out.write((const char*) record, sizeof(record));
+            }
+            else
+            {
+                out << b.fen << ',';
+
+                if (b.wdlState != FAIL)
+                    out << int(b.wdl);
+
+                out << ',';
+
+                if (b.dtzState != FAIL)
+                    out << b.dtz;
+
+                out << '\n';
+            }
+        }
+
+        positions += batch.size();
+    }
+
+    const TimePoint elapsed = now() - start + 1;  // Ensure positivity to avoid a 'divide by zero'
+
+    std::stringstream ss;
+    ss << "Probed " << positions << " positions in " << elapsed << " ms, "
+       << positions * 1000 / elapsed << " positions/s, WDL found " << wdlFound << ", DTZ found "
+       << dtzFound << ", results in " << output;
+    return ss.str();
+}
+
+
 
 // Use the DTZ tables to rank root moves.
 //
@@ -1595,10 +2957,10 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
 bool Tablebases::root_probe(Position&          pos,
                             Search::RootMoves& rootMoves,
                             bool               rule50,
-                            bool               rankDTZ) {
+                            bool               rankDTZ,
+                            ThreadPool*        threads) {
 
-    ProbeState result = OK;
-    StateInfo  st;
+    StateInfo st;
 
     // Obtain 50-move counter for the root position
     int cnt50 = pos.rule50_count();
@@ -1606,41 +2968,89 @@ bool Tablebases::root_probe(Position&          pos,
     // Check whether a position was repeated since the last zeroing move.
     bool rep = pos.has_repeated();
 
-    int dtz, bound = rule50 ? (MAX_DTZ / 2 - 100) : 1;
+    int bound = rule50 ? (MAX_DTZ / 2 - 100) : 1;
+
+    // The positions after the root moves are probed on their own copies, in
+    // parallel by the idle threads of the pool when one is given. The draws by
+    // repetition need the game history, so they are detected beforehand.
+    struct Child {
+        PackedPosition packed;
+        bool           zeroing, draw;
+        int            dtz;
+        ProbeState     result;
+    };
+
+    std::vector<Child> children;
 
-    // Probe and rank each move
     for (auto& m : rootMoves)
     {
         pos.do_move(m.pv[0], st);
 
+        // In case a root move leads to a draw by repetition or 50-move rule, we
+        // set dtz to zero. Note: since we are only 1 ply from the root, this must
+        // be a true 3-fold repetition inside the game history.
+        bool zeroing = pos.rule50_count() == 0;
+        children.push_back({pos.encode(), zeroing, !zeroing && pos.is_draw(1), 0, OK});
+
+        pos.undo_move(m.pv[0]);
+    }
+
+    auto probe = [&](Child& c, Position& p, StateInfo& s) {
+        if (c.draw)
+            return;
+
+        p.decode(c.packed, &s);
+
         // Calculate dtz for the current move counting from the root position
-        if (pos.rule50_count() == 0)
+        if (c.zeroing)
         {
             // In case of a zeroing move, dtz is one of -101/-1/0/1/101
-            WDLScore wdl = -probe_wdl(pos, &result);
-            dtz          = dtz_before_zeroing(wdl);
-        }
-        else if (pos.is_draw(1))
-        {
-            // In case a root move leads to a draw by repetition or 50-move rule,
-            // we set dtz to zero. Note: since we are only 1 ply from the root,
-            // this must be a true 3-fold repetition inside the game history.
-            dtz = 0;
+            WDLScore wdl = -probe_wdl(p, &c.result);
+            c.dtz        = dtz_before_zeroing(wdl);
         }
         else
         {
             // Otherwise, take dtz for the new position and correct by 1 ply
-            dtz = -probe_dtz(pos, &result);
-            dtz = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : dtz;
+            int dtz = -probe_dtz(p, &c.result);
+            c.dtz   = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : dtz;
         }
 
         // Make sure that a mating move is assigned a dtz value of 1
-        if (pos.checkers() && dtz == 2 && MoveList<LEGAL>(pos).size() == 0)
-            dtz = 1;
+        if (p.checkers() && c.dtz == 2 && move_count<LEGAL>(p) == 0)
+            c.dtz = 1;
+    };
 
-        pos.undo_move(m.pv[0]);
+    if (threads && threads->num_threads() > 1)
+    {
+        std::atomic<size_t> nextChild(0);
 
-        if (result == FAIL)
+        for (size_t i = 0; i < threads->num_threads(); ++i)
+            threads->run_on_thread(i, [&]() {
+                StateInfo s;
+                Position  p;
+
+                for (size_t idx; (idx = nextChild.fetch_add(1)) < children.size();)
+                    probe(children[idx], p, s);
+            });
+
+        for (size_t i = 0; i < threads->num_threads(); ++i)
+            threads->wait_on_thread(i);
+    }
+    else
+    {
+        Position p;
+
+        for (Child& c : children)
+            probe(c, p, st);
+    }
+
+    // Rank each move
+    for (size_t i = 0; i < rootMoves.size(); ++i)
+    {
+        auto&     m   = rootMoves[i];
+        const int dtz = children[i].dtz;
+
+        if (children[i].result == FAIL)
             return false;
 
         // Better moves are ranked higher. Certain wins are ranked equally.
@@ -1708,7 +3118,8 @@ bool Tablebases::root_probe_wdl(Position& pos, Search::RootMoves& rootMoves, boo
 Config Tablebases::rank_root_moves(const OptionsMap&  options,
                                    Position&          pos,
                                    Search::RootMoves& rootMoves,
-                                   bool               rankDTZ) {
+                                   bool               rankDTZ,
+                                   ThreadPool*        threads) {
     Config config;
 
     if (rootMoves.empty())
@@ -1729,16 +3140,22 @@ Config Tablebases::rank_root_moves(const OptionsMap&  options,
         config.probeDepth  = 0;
     }
 
+    // Read ahead the tables the search may reach with one or two captures
+    if (config.cardinality && int(options["SyzygyPrefetch"]))
+        prefetch_tables(pos, config.cardinality, size_t(int(options["SyzygyPrefetch"])) << 20);
+
     if (config.cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
     {
         // Rank moves using DTZ tables
-        config.rootInTB = root_probe(pos, rootMoves, options["Syzygy50MoveRule"], rankDTZ);
+        config.rootInTB = probe_when_mapped(
+          [&] { return root_probe(pos, rootMoves, options["Syzygy50MoveRule"], rankDTZ, threads); });
 
         if (!config.rootInTB)
         {
             // DTZ tables are missing; try to rank moves using WDL tables
             dtz_available   = false;
-            config.rootInTB = root_probe_wdl(pos, rootMoves, options["Syzygy50MoveRule"]);
+            config.rootInTB = probe_when_mapped(
+              [&] { return root_probe_wdl(pos, rootMoves, options["Syzygy50MoveRule"]); });
         }
     }
 
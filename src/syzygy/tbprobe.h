@@ -19,6 +19,8 @@
 #ifndef TBPROBE_H
 #define TBPROBE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -26,6 +28,7 @@
 namespace Hypnos {
 class Position;
 class OptionsMap;
+class ThreadPool;
 
 using Depth = int;
 
@@ -60,18 +63,59 @@ enum ProbeState {
     ZEROING_BEST_MOVE = 2    // Best move zeroes DTZ (capture or pawn move)
 };
 
+struct ProbeStats {
+    uint64_t stalls;      // Probes slower than the stall threshold
+    uint64_t stallTime;   // Their total time in microseconds
+    uint64_t prefetched;  // Bytes of table files read ahead
+};
+
+// A position of a batch probe, with its results once probed. Positions with
+// castling rights or too many pieces are not probed, both states stay FAIL.
+struct BatchProbe {
+    std::string fen;
+    WDLScore    wdl      = WDLDraw;
+    int         dtz      = 0;
+    ProbeState  wdlState = FAIL;
+    ProbeState  dtzState = FAIL;
+};
+
+// Memory held by the tablebases, in bytes. The mapped files are backed by the
+// page cache and shared with other processes, the rest is private.
+struct MemoryUsage {
+    uint64_t mapped = 0;  // Table files mapped at their first probe
+    uint64_t pinned = 0;  // Table files read in memory, with their decoded blocks
+    uint64_t caches = 0;  // WDL and DTZ probe caches
+    uint64_t tables = 0;  // Table objects and their hash
+};
+
 extern int MaxCardinality;
 
 
-void     init(const std::string& paths);
-WDLScore probe_wdl(Position& pos, ProbeState* result);
-int      probe_dtz(Position& pos, ProbeState* result);
-bool     root_probe(Position& pos, Search::RootMoves& rootMoves, bool rule50, bool rankDTZ);
-bool     root_probe_wdl(Position& pos, Search::RootMoves& rootMoves, bool rule50);
-Config   rank_root_moves(const OptionsMap&  options,
-                         Position&          pos,
-                         Search::RootMoves& rootMoves,
-                         bool               rankDTZ = false);
+void        init(const std::string& paths, bool rescan = true);
+void        set_cache_size(size_t mbSize);
+void        set_pinned(const std::string& codes, size_t decodeMb);
+size_t      cache_size();
+size_t      cache_memory_size(size_t mbSize);
+MemoryUsage memory_usage();
+ProbeStats  probe_stats();
+std::string stress_test(size_t threadCount, int ms);
+std::string stats();
+void        reset_stats();
+WDLScore    probe_wdl(Position& pos, ProbeState* result);
+int         probe_dtz(Position& pos, ProbeState* result);
+void        probe_batch(std::vector<BatchProbe>& batch, ThreadPool& threads);
+std::string probe_file(const std::string& input, const std::string& output, ThreadPool& threads);
+bool        root_probe(Position&          pos,
+                       Search::RootMoves& rootMoves,
+                       bool               rule50,
+                       bool               rankDTZ,
+                       ThreadPool*        threads = nullptr);
+bool        root_probe_wdl(Position& pos, Search::RootMoves& rootMoves, bool rule50);
+Config      rank_root_moves(const OptionsMap&  options,
+                            Position&          pos,
+                            Search::RootMoves& rootMoves,
+                            bool               rankDTZ = false,
+                            ThreadPool*        threads = nullptr);
 
 }  // namespace Hypnos::Tablebases
 
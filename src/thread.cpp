@@ -51,10 +51,12 @@ Thread::Thread(Search::SharedState&                    sharedState,
     run_custom_job([this, &binder, &sharedState, &sm, n]() {
         // Use the binder to [maybe] bind the threads to a NUMA node before doing
         // the Worker allocation. Ideally we would also allocate the SearchManager
-        // here, but that's minor.
+        // here, but that's minor. The Worker, with its histories, gets fresh pages
+        // that its constructor touches first, so they are placed on the NUMA node
+        // of the thread and not on the node of the memory reused from the heap.
         this->numaAccessToken = binder();
-        this->worker =
-          std::make_unique<Search::Worker>(sharedState, std::move(sm), n, this->numaAccessToken);
+        this->worker          = make_unique_large_page<Search::Worker>(sharedState, std::move(sm), n,
+                                                                       this->numaAccessToken);
     });
 
     wait_for_search_finished();
@@ -133,21 +135,26 @@ uint64_t ThreadPool::tb_hits() const { return accumulate(&Search::Worker::tbHits
 
 // Creates/destroys threads to match the requested number.
 // Created and launched threads will immediately go to sleep in idle_loop.
-// Upon resizing, threads are recreated to allow for binding if necessary.
+// Upon resizing, the threads keep their worker, with its histories, as long as
+// their NUMA binding is unchanged. The others are recreated to allow for binding,
+// all of them when a rebuild is requested, for instance on a new NUMA config.
 void ThreadPool::set(const NumaConfig&                           numaConfig,
                      Search::SharedState                         sharedState,
-                     const Search::SearchManager::UpdateContext& updateContext) {
+                     const Search::SearchManager::UpdateContext& updateContext,
+                     bool                                        rebuild) {
 
-    if (threads.size() > 0)  // destroy any existing thread(s)
-    {
+    if (threads.size() > 0)
         main_thread()->wait_for_search_finished();
 
+    if (rebuild)  // destroy any existing thread(s)
+    {
         threads.clear();
 
         boundThreadToNumaNode.clear();
     }
 
     const size_t requested = sharedState.options["Threads"];
+    const size_t previous  = threads.size();
 
     if (requested > 0)  // create new thread(s)
     {
@@ -169,9 +176,19 @@ void ThreadPool::set(const NumaConfig&                           numaConfig,
             return true;
         }();
 
-        boundThreadToNumaNode = doBindThreads
-                                ? numaConfig.distribute_threads_among_numa_nodes(requested)
-                                : std::vector<NumaIndex>{};
+        std::vector<NumaIndex> binding =
+          doBindThreads ? numaConfig.distribute_threads_among_numa_nodes(requested)
+                        : std::vector<NumaIndex>{};
+
+        // Keep the leading threads bound as before, destroy the others
+        size_t kept = 0;
+        while (kept < std::min(previous, requested)
+               && boundThreadToNumaNode.empty() == binding.empty()
+               && (binding.empty() || boundThreadToNumaNode[kept] == binding[kept]))
+            ++kept;
+
+        threads.resize(kept);
+        boundThreadToNumaNode = std::move(binding);
 
         while (threads.size() < requested)
         {
@@ -192,10 +209,23 @@ void ThreadPool::set(const NumaConfig&                           numaConfig,
               std::make_unique<Thread>(sharedState, std::move(manager), threadId, binder));
         }
 
-        clear();
+        // New workers are cleared by their constructor, the kept ones only
+        // need their reductions updated to the new number of threads.
+        if (!kept)
+            clear();
+
+        else if (previous != requested)
+            for (size_t i = 0; i < kept; ++i)
+                threads[i]->worker->init_reductions();
 
         main_thread()->wait_for_search_finished();
     }
+    else
+    {
+        threads.clear();
+
+        boundThreadToNumaNode.clear();
+    }
 }
 
 
@@ -262,7 +292,7 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
         for (const auto& m : legalmoves)
             rootMoves.emplace_back(m);
 
-    Tablebases::Config tbConfig = Tablebases::rank_root_moves(options, pos, rootMoves);
+    Tablebases::Config tbConfig = Tablebases::rank_root_moves(options, pos, rootMoves, false, this);
 
     // After ownership transfer 'states' becomes empty, so if we stop the search
     // and call 'go' again without setting a new position states.get() == nullptr.
@@ -271,11 +301,16 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
     if (states.get())
         setupStates = std::move(states);  // Ownership transfer, states is now empty
 
-    // We use Position::set() to set root position across threads. But there are
+    // We use Position::decode() to set root position across threads. But there are
     // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
-    // be deduced from a fen string, so set() clears them and they are set from
-    // setupStates->back() later. The rootState is per thread, earlier states are
-    // shared since they are read-only.
+    // be deduced from the packed position, so decode() clears them and they are set
+    // from setupStates->back() later. The rootState is per thread, earlier states
+    // are shared since they are read-only. Positions with too many pieces to be
+    // packed are set from their FEN.
+    const bool           packed    = pos.packable();
+    const PackedPosition packedPos = packed ? pos.encode() : PackedPosition{};
+    const std::string    fen       = packed ? std::string() : pos.fen();
+
     for (auto&& th : threads)
     {
         th->run_custom_job([&]() {
@@ -284,7 +319,10 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
               th->worker->bestMoveChanges          = 0;
             th->worker->rootDepth = th->worker->completedDepth = 0;
             th->worker->rootMoves                              = rootMoves;
-            th->worker->rootPos.set(pos.fen(), pos.is_chess960(), &th->worker->rootState);
+            if (packed)
+                th->worker->rootPos.decode(packedPos, &th->worker->rootState);
+            else
+                th->worker->rootPos.set(fen, pos.is_chess960(), &th->worker->rootState);
             th->worker->rootState = setupStates->back();
             th->worker->tbConfig  = tbConfig;
         });
@@ -28,6 +28,7 @@
 #include <mutex>
 #include <vector>
 
+#include "memory.h"
 #include "numa.h"
 #include "position.h"
 #include "search.h"
@@ -89,10 +90,11 @@ class Thread {
     // appropriate specificity regarding search, from the point of view of an
     // outside user, so renaming of this function is left for whenever that happens.
     void   wait_for_search_finished();
-    size_t id() const { return idx; }
+    size_t    id() const { return idx; }
+    NumaIndex numa_node() const { return numaAccessToken.get_numa_index(); }
 
-    std::unique_ptr<Search::Worker> worker;
-    std::function<void()>           jobFunc;
+    LargePagePtr<Search::Worker> worker;
+    std::function<void()>        jobFunc;
 
    private:
     std::mutex                mutex;
@@ -134,7 +136,8 @@ class ThreadPool {
     void   clear();
     void   set(const NumaConfig& numaConfig,
                Search::SharedState,
-               const Search::SearchManager::UpdateContext&);
+               const Search::SearchManager::UpdateContext&,
+               bool rebuild = false);
 
     Search::SearchManager* main_manager();
     Thread*                main_thread() const { return threads.front().get(); }
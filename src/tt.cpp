@@ -190,6 +190,15 @@ void TranspositionTable::clear(ThreadPool& threads) {
 }
 
 
+// Each thread clears its own part of the table, so with bound threads the
+// table ends up spread over the NUMA nodes.
+std::vector<size_t> TranspositionTable::numa_placement() const {
+    return pages_per_numa_node(table, clusterCount * sizeof(Cluster), 1024);
+}
+
+size_t TranspositionTable::memory_size() const { return table ? clusterCount * sizeof(Cluster) : 0; }
+
+
 // Returns an approximation of the hashtable
 // occupation during a search. The hash is x permill full, as per UCI protocol.
 // Only counts entries which match the current generation.
@@ -22,6 +22,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <tuple>
+#include <vector>
 
 #include "memory.h"
 #include "types.h"
@@ -83,6 +84,8 @@ class TranspositionTable {
     probe(const Key key) const;  // The main method, whose retvals separate local vs global objects
     TTEntry* first_entry(const Key key)
       const;  // This is the hash function; its only external use is memory prefetching.
+    std::vector<size_t> numa_placement() const;  // Sampled pages on each NUMA node
+    size_t              memory_size() const;     // Size of the table in bytes
 
    private:
     friend struct TTEntry;
@@ -35,6 +35,16 @@
 //
 // -DUSE_PEXT    | Add runtime support for use of pext asm-instruction. Works
 //               | only in 64-bit mode and requires hardware with pext support.
+//
+// -DUSE_ATTACK_MAPS | Maintain the squares attacked by each color and piece
+//                   | type in StateInfo, updated incrementally at each move.
+//
+// -DUSE_SLIDER_BACKENDS | Select the slider attack backend at run time. Without
+//                       | it the backend is fixed at compile time, and BMI2
+//                       | builds use pext, which is slow on AMD before Zen 3.
+//
+// -DUSE_LEGAL_STAGES | Generate only legal moves in the MovePicker stages, so
+//                    | that search does not verify them with Position::legal().
 
     #include <cassert>
     #include <cstdint>
@@ -96,6 +106,24 @@ constexpr bool HasPext = true;
 constexpr bool HasPext = false;
     #endif
 
+    #ifdef USE_ATTACK_MAPS
+constexpr bool HasAttackMaps = true;
+    #else
+constexpr bool HasAttackMaps = false;
+    #endif
+
+    #ifdef USE_SLIDER_BACKENDS
+constexpr bool HasSliderBackends = true;
+    #else
+constexpr bool HasSliderBackends = false;
+    #endif
+
+    #ifdef USE_LEGAL_STAGES
+constexpr bool HasLegalStages = true;
+    #else
+constexpr bool HasLegalStages = false;
+    #endif
+
     #ifdef IS_64BIT
 constexpr bool Is64Bit = true;
     #else
@@ -143,6 +143,10 @@ void UCIEngine::loop() {
             // send info strings after the go command is sent for old GUIs and python-chess
             print_info_string(engine.numa_config_information_as_string());
             print_info_string(engine.thread_binding_information_as_string());
+
+            if (!std::exchange(memoryReported, true))
+                print_info_string(engine.memory_information_as_string(false));
+
             go(is);
         }
         else if (token == "position")
@@ -175,6 +179,18 @@ void UCIEngine::loop() {
             engine.flip();
         else if (token == "bench")
             bench(is);
+        else if (token == "solve")
+            solve(is);
+        else if (token == "perft960")
+            perft960(is);
+        else if (token == "tb")
+            tb(is);
+        else if (token == "attacks")
+        {
+            // The benchmark switches the slider attack backend
+            engine.wait_for_search_finished();
+            sync_cout << Benchmark::attacks_bench() << sync_endl;
+        }
         else if (token == "d")
             sync_cout << engine.visualize() << sync_endl;
         else if (token == "eval")
@@ -183,6 +199,26 @@ void UCIEngine::loop() {
             engine.show_moves_bookMan(pos);
         else if (token == "compiler")
             sync_cout << compiler_info() << sync_endl;
+        else if (token == "numa")
+        {
+            std::string sysfs = "/sys/devices";
+            size_t      numThreads = engine.get_options()["Threads"];
+
+            if (is >> token && token == "topology")
+            {
+                is >> sysfs >> numThreads;
+                sync_cout << engine.numa_topology_information_as_string(sysfs, numThreads)
+                          << sync_endl;
+            }
+            else if (token == "bench")
+                numa_bench(is);
+            else
+                sync_cout << engine.numa_config_information_as_string() << "\n"
+                          << engine.thread_binding_information_as_string() << "\n"
+                          << engine.numa_placement_information_as_string() << sync_endl;
+        }
+        else if (token == "memory")
+            sync_cout << engine.memory_information_as_string(true) << sync_endl;
         else if (token == "export_net")
         {
             std::pair<std::optional<std::string>, std::string> files[2];
@@ -261,7 +297,7 @@ void UCIEngine::go(std::istringstream& is) {
 }
 
 void UCIEngine::bench(std::istream& args) {
-    std::string token;
+    std::string token, cmd;
     uint64_t    num, nodes = 0, cnt = 1;
     uint64_t    nodesSearched = 0;
     const auto& options       = engine.get_options();
@@ -271,14 +307,13 @@ void UCIEngine::bench(std::istream& args) {
         on_update_full(i, options["UCI_ShowWDL"]);
     });
 
-    std::vector<std::string> list = Benchmark::setup_bench(engine.fen(), args);
+    Benchmark::BenchCommands commands(engine.fen(), args);
 
-    num = count_if(list.begin(), list.end(),
-                   [](const std::string& s) { return s.find("go ") == 0 || s.find("eval") == 0; });
+    num = commands.positions();
 
     TimePoint elapsed = now();
 
-    for (const auto& cmd : list)
+    while (commands.next(cmd))
     {
         std::istringstream is(cmd);
         is >> std::skipws >> token;
@@ -337,6 +372,212 @@ void UCIEngine::bench(std::istream& args) {
     engine.set_on_update_full([&](const auto& i) { on_update_full(i, options["UCI_ShowWDL"]); });
 }
 
+// Runs an EPD test suite. Each position with a "bm" or "am" opcode is searched
+// for a fixed time, and is solved when the final best move is one of the "bm"
+// moves, or none of the "am" moves. The time to solution is the time from
+// which the main line has started with a solution move for good. Usage:
+//
+// solve <file> [movetime in ms] [threads] [hash in MB]
+void UCIEngine::solve(std::istream& args) {
+    std::string          file, movetime = "1000", token;
+    Benchmark::EpdReader reader;
+    Benchmark::EpdRecord rec;
+    std::string_view     line;
+    auto&                options = engine.get_options();
+
+    if (!(args >> file) || !reader.open(file))
+    {
+        sync_cout << "info string Unable to open file " << file << sync_endl;
+        return;
+    }
+
+    if (args >> token)
+        movetime = token;
+
+    for (auto name : {"Threads", "Hash"})
+        if (args >> token)
+        {
+            std::istringstream is(std::string("name ") + name + " value " + token);
+            setoption(is);
+        }
+
+    std::vector<std::string> solutions;
+    std::string              bestMove;
+    bool                     avoid    = false;
+    TimePoint                solvedAt = -1;
+
+    auto is_solution = [&](std::string_view m) {
+        return (std::find(solutions.begin(), solutions.end(), m) != solutions.end()) != avoid;
+    };
+
+    engine.set_on_update_full([&](const auto& i) {
+        if (i.multiPV != 1)
+            return;
+
+        if (!is_solution(i.pv.substr(0, i.pv.find(' '))))
+            solvedAt = -1;
+        else if (solvedAt < 0)
+            solvedAt = TimePoint(i.timeMs);
+    });
+    engine.set_on_bestmove([&](std::string_view bm, std::string_view) { bestMove = bm; });
+
+    uint64_t  cnt = 0, solved = 0;
+    TimePoint totalTime = 0, solvedTime = 0, elapsed = now();
+
+    while (reader.next(line))
+    {
+        if (!Benchmark::parse_epd(line, rec)
+            || (rec.bestMoves.empty() && rec.avoidMoves.empty()))
+            continue;
+
+        engine.set_position(rec.fen, rec.moves);
+
+        avoid = rec.bestMoves.empty();
+        solutions.clear();
+
+        for (const auto& s : avoid ? rec.avoidMoves : rec.bestMoves)
+        {
+            Move m = to_move(engine.pos, s);
+
+            if (m == Move::none())
+                m = Benchmark::parse_san(engine.pos, s);
+
+            if (m != Move::none())
+                solutions.push_back(move(m, engine.pos.is_chess960()));
+        }
+
+        ++cnt;
+
+        if (solutions.empty())
+        {
+            sync_cout << "info string Position " << cnt << " (" << rec.id
+                      << "): no legal solution move, skipped" << sync_endl;
+            continue;
+        }
+
+        std::istringstream is("movetime " + movetime);
+        Search::LimitsType limits = parse_limits(is);
+
+        engine.search_clear();
+        solvedAt        = -1;
+        TimePoint start = now();
+        engine.go(limits);
+        engine.wait_for_search_finished();
+        totalTime += now() - start;
+
+        sync_cout_start();
+        std::cout << "Position " << cnt << " (" << rec.id << "): bestmove " << bestMove;
+
+        if (is_solution(bestMove))
+        {
+            solvedAt = solvedAt < 0 ? now() - start : solvedAt;
+            solvedTime += solvedAt;
+            ++solved;
+            std::cout << " solved in " << solvedAt << " ms" << std::endl;
+        }
+        else
+            std::cout << " not solved" << std::endl;
+        sync_cout_end();
+    }
+
+    elapsed = now() - elapsed;
+
+    sync_cout << "\n==========================="                                          //
+              << "\nSolved          : " << solved << '/' << cnt                           //
+              << "\nSearch time (ms): " << totalTime                                      //
+              << "\nTotal time (ms) : " << elapsed                                        //
+              << "\nAverage time to solution (ms): " << (solved ? solvedTime / solved : 0)
+              << sync_endl;
+
+    engine.set_on_update_full([&](const auto& i) { on_update_full(i, options["UCI_ShowWDL"]); });
+    engine.set_on_bestmove([](const auto& bm, const auto& p) { on_bestmove(bm, p); });
+}
+
+// Measures the speed and the memory cost of the networks replicated per NUMA
+// node and per L3 domain. The threads are bound per L3 domain in both runs, so
+// that only the number of replicas changes, and the bench positions are searched
+// for a fixed time with each. Usage:
+//
+// numa bench [threads] [movetime in ms] [fen file]
+void UCIEngine::numa_bench(std::istream& args) {
+    auto&             options     = engine.get_options();
+    const std::string policy      = options["NumaPolicy"];
+    const std::string replication = options["NumaReplication"] == "l3" ? "l3" : "node";
+    std::string       threads = std::to_string(int(options["Threads"])), movetime = "100";
+    std::string       fenFile = "default", token, cmd;
+    std::stringstream results;
+    uint64_t          nodesSearched = 0;
+
+    if (args >> token)
+        threads = token;
+    if (args >> token)
+        movetime = token;
+    if (args >> token)
+        fenFile = token;
+
+    std::istringstream       benchArgs("16 " + threads + " " + movetime + " " + fenFile
+                                       + " movetime");
+    Benchmark::BenchCommands commands(engine.fen(), benchArgs);
+
+    engine.set_on_update_full([&](const auto& i) { nodesSearched = i.nodes; });
+
+    for (const std::string option : {"NumaPolicy value l3", "NumaReplication value node",
+                                     "NumaReplication value l3"})
+    {
+        std::istringstream is("name " + option);
+        setoption(is);
+
+        if (option.find("NumaReplication") == std::string::npos)
+            continue;
+
+        uint64_t  nodes   = 0;
+        TimePoint elapsed = 0;
+
+        commands.rewind();
+
+        while (commands.next(cmd))
+        {
+            std::istringstream cis(cmd);
+            cis >> std::skipws >> token;
+
+            if (token == "go")
+            {
+                Search::LimitsType limits = parse_limits(cis);
+                TimePoint          start  = now();
+
+                engine.go(limits);
+                engine.wait_for_search_finished();
+                elapsed += now() - start;
+                nodes += nodesSearched;
+                nodesSearched = 0;
+            }
+            else if (token == "setoption")
+                setoption(cis);
+            else if (token == "position")
+                position(cis);
+            else if (token == "ucinewgame")
+                engine.search_clear();
+        }
+
+        const auto [replicas, bytes] = engine.get_network_replication();
+
+        results << "\nReplication per " << (option.back() == '3' ? "L3 domain" : "NUMA node")
+                << ": " << replicas << (replicas > 1 ? " replicas, " : " replica, ")
+                << Util::format_bytes(bytes, 1) << ", " << 1000 * nodes / (elapsed + 1)
+                << " nodes/second";
+    }
+
+    for (const auto& option : {"NumaReplication value " + replication,
+                              "NumaPolicy value " + policy})
+    {
+        std::istringstream is("name " + option);
+        setoption(is);
+    }
+
+    sync_cout << "\n===========================" << results.str() << sync_endl;
+
+    engine.set_on_update_full([&](const auto& i) { on_update_full(i, options["UCI_ShowWDL"]); });
+}
 
 void UCIEngine::setoption(std::istringstream& is) {
     engine.wait_for_search_finished();
@@ -344,11 +585,77 @@ void UCIEngine::setoption(std::istringstream& is) {
 }
 
 std::uint64_t UCIEngine::perft(const Search::LimitsType& limits) {
+    TimePoint elapsed = now();
+
     auto nodes = engine.perft(engine.fen(), limits.perft, engine.get_options()["UCI_Chess960"]);
-    sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+
+    elapsed = now() - elapsed + 1;  // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "\nNodes searched: " << nodes << "\nNodes/second  : " << 1000 * nodes / elapsed
+              << "\n" << sync_endl;
     return nodes;
 }
 
+// Runs the Chess960 and Double Fischer Random perft suite with the current
+// Threads and Hash settings. Usage: perft960 [chess960 depth=4] [dfrc depth=2]
+void UCIEngine::perft960(std::istream& args) {
+    Depth chess960Depth = 4, dfrcDepth = 2, depth;
+
+    if (args >> depth)
+        chess960Depth = std::max(depth, 0);
+
+    if (args >> depth)
+        dfrcDepth = std::max(depth, 0);
+
+    const bool ok = engine.perft960(chess960Depth, dfrcDepth);
+
+    sync_cout << "\nperft960 " << (ok ? "OK" : "FAILED") << "\n" << sync_endl;
+}
+
+// Tablebase diagnostics. Usage: tb stats | tb reset | tb stress [threads=256] [ms=2000]
+void UCIEngine::tb(std::istream& args) {
+    std::string token;
+    args >> token;
+
+    if (token == "stats")
+        sync_cout << Tablebases::stats() << sync_endl;
+    else if (token == "reset")
+        Tablebases::reset_stats();
+    else if (token == "stress")
+    {
+        size_t threadCount = 256;
+        int    ms          = 2000, value;
+
+        if (args >> value)
+            threadCount = std::max(value, 1);
+
+        if (args >> value)
+            ms = std::max(value, 0);
+
+        // Reloading the tables prints, so the report is not built within sync_cout
+        const std::string report = engine.tb_stress(threadCount, ms);
+        sync_cout << report << sync_endl;
+    }
+    else if (token == "probe")
+    {
+        std::string input, output;
+        args >> input >> output;
+
+        if (input.empty())
+        {
+            sync_cout << "Usage: tb probe <fen file> [output file, .csv or .bin]" << sync_endl;
+            return;
+        }
+
+        if (output.empty())
+            output = input + ".csv";
+
+        sync_cout << engine.tb_probe(input, output) << sync_endl;
+    }
+    else
+        sync_cout << "Unknown tb command: '" << token << "'" << sync_endl;
+}
+
 void UCIEngine::position(std::istringstream& is) {
     std::string token, fen;
 
@@ -59,14 +59,19 @@ class UCIEngine {
    private:
     Engine      engine;
     CommandLine cli;
+    bool        memoryReported = false;  // Footprint sent after the first go
 
     static void print_info_string(const std::string& str);
 
     void          go(std::istringstream& is);
     void          bench(std::istream& args);
+    void          solve(std::istream& args);
+    void          numa_bench(std::istream& args);
     void          position(std::istringstream& is);
     void          setoption(std::istringstream& is);
     std::uint64_t perft(const Search::LimitsType&);
+    void          perft960(std::istream& args);
+    void          tb(std::istream& args);
 
     static void on_update_no_moves(const Engine::InfoShort& info);
     static void on_update_full(const Engine::InfoFull& info, bool showWDL);
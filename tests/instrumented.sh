@@ -102,6 +102,35 @@ network=`./stockfish uci | grep 'option name EvalFile type string default' | awk
 echo "Comparing $network to the written verify.nnue"
 diff $network verify.nnue
 
+# thread placement on a fake sysfs tree: 2 NUMA nodes of 8 processors, each with
+# 4 performance and 4 efficiency cores in their own L3 domains
+sysfs=fake_sysfs
+rm -rf $sysfs
+mkdir -p $sysfs/system/node/node0 $sysfs/system/node/node1 $sysfs/cpu_core $sysfs/cpu_atom
+echo 0-1 > $sysfs/system/node/online
+echo 0-7 > $sysfs/system/node/node0/cpulist
+echo 8-15 > $sysfs/system/node/node1/cpulist
+echo 0-3,8-11 > $sysfs/cpu_core/cpus
+echo 4-7,12-15 > $sysfs/cpu_atom/cpus
+for cpu in $(seq 0 15); do
+  for index in 0 1 2 3; do
+    level=$((index > 0 ? index : 1))
+    cache=$sysfs/system/cpu/cpu$cpu/cache/index$index
+    mkdir -p $cache
+    echo $level > $cache/level
+    echo $((cpu / 4 * 4))-$((cpu / 4 * 4 + 3)) > $cache/shared_cpu_list
+  done
+done
+echo 0-15 > $sysfs/system/cpu/online
+
+echo "$prefix $exeprefix ./stockfish numa topology $sysfs 6 $postfix"
+eval "$prefix $exeprefix ./stockfish numa topology $sysfs 6 $postfix"
+./stockfish numa topology $sysfs 6 | grep "L3 domains 4, fast processors 8"
+./stockfish numa topology $sysfs 6 | grep "Policy fast: 0-3:8-11:4-7:12-15, 6 threads bound 4/4:2/4:0/4:0/4"
+./stockfish numa topology $sysfs 6 | grep "Policy l3: 0-3:4-7:8-11:12-15, 6 threads bound 4/4:2/4:0/4:0/4, 2 replicas"
+./stockfish numa topology $sysfs 6 | grep "Replication l3: 4 replicas"
+rm -rf $sysfs
+
 # more general testing, following an uci protocol exchange
 cat << EOF > game.exp
  set timeout 240
@@ -126,6 +155,12 @@ cat << EOF > game.exp
  send "go depth 10\n"
  expect "bestmove"
 
+ # more pieces than a PackedPosition holds
+ send "position fen rnbqkbnr/pppppppp/8/2nn4/2NN4/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1\n"
+ send "go depth 5\n"
+ expect "bestmove"
+ send "eval\n"
+
  send "setoption name UCI_ShowWDL value true\n"
  send "position startpos\n"
  send "flip\n"
@@ -162,12 +197,22 @@ if [ ! -d ../tests/syzygy ]; then
    mv niklasf-python-chess-9b9aa13 ../tests/syzygy
 fi
 
+cat << EOF > tb_probe.epd
+8/8/8/8/8/2k5/8/KR6 w - - 0 1
+8/8/8/8/8/2k5/8/KQ6 b - - 0 1
+4k3/8/8/8/8/8/8/R3K2R w KQ - 0 1
+EOF
+
 cat << EOF > syzygy.exp
  set timeout 240
  spawn $exeprefix ./stockfish
  send "uci\n"
  send "setoption name SyzygyPath value ../tests/syzygy/\n"
  expect "info string Found 35 tablebases" {} timeout {exit 1}
+ send "tb stress 64 1000\n"
+ expect "Probe latency" {} timeout {exit 1}
+ send "tb probe tb_probe.epd\n"
+ expect "Probed 3 positions" {} timeout {exit 1}
  send "bench 128 1 8 default depth\n"
  send "ucinewgame\n"
  send "position fen 4k3/PP6/8/8/8/8/8/4K3 w - - 0 1\n"
@@ -194,6 +239,6 @@ do
 
 done
 
-rm -f tsan.supp bench_tmp.epd
+rm -f tsan.supp bench_tmp.epd tb_probe.epd tb_probe.epd.csv
 
 echo "instrumented testing OK"
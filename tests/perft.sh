@@ -12,9 +12,10 @@ echo "perft testing started"
 
 cat << EOF > perft.exp
    set timeout 10
-   lassign \$argv pos depth result
+   lassign \$argv pos depth result threads
+   if {\$threads eq ""} {set threads 1}
    spawn ./stockfish
-   send "position \$pos\\ngo perft \$depth\\n"
+   send "setoption name Threads value \$threads\\nposition \$pos\\ngo perft \$depth\\n"
    expect "Nodes searched? \$result" {} timeout {exit 1}
    send "quit\\n"
    expect eof
@@ -27,6 +28,24 @@ expect perft.exp "fen r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq
 expect perft.exp "fen rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8" 5 89941194 > /dev/null
 expect perft.exp "fen r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10" 5 164075551 > /dev/null
 
-rm perft.exp
+# multi-threaded perft must give the same node counts
+expect perft.exp startpos 5 4865609 4 > /dev/null
+expect perft.exp "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -" 5 193690690 4 > /dev/null
+
+# all Chess960 and Double Fischer Random starting positions must match the
+# stored totals, the node rate of each family is reported
+cat << EOF > perft960.exp
+   set timeout 60
+   lassign \$argv depth dfrcdepth threads
+   spawn ./stockfish
+   send "setoption name Threads value \$threads\\nperft960 \$depth \$dfrcdepth\\n"
+   expect "perft960 OK" {} "FAILED" {exit 1} timeout {exit 1}
+   send "quit\\n"
+   expect eof
+EOF
+
+expect perft960.exp 4 2 4
+
+rm perft.exp perft960.exp
 
 echo "perft testing OK"